@@ -0,0 +1,89 @@
+/*
+   Copyright (c) 2021 Christian Döring
+   Permission is hereby granted, free of charge, to any person obtaining a copy
+   of this software and associated documentation files (the "Software"), to deal
+   in the Software without restriction, including without limitation the rights
+   to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+   copies of the Software, and to permit persons to whom the Software is
+   furnished to do so, subject to the following conditions:
+   The above copyright notice and this permission notice shall be included in all
+   copies or substantial portions of the Software.
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+   IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+   FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+   AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+   LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+   OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+   SOFTWARE.
+   */
+
+
+#ifndef BENCH_H
+#define BENCH_H
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <time.h>
+
+/*
+ * Helpers shared by the standalone benchmarks in this directory. Every
+ * benchmark is a single file with a main(), built from the repository root:
+ *
+ *   cc -O2 -std=gnu11 -I. -pthread bench/<name>.c -o <name>
+ */
+
+/*
+ * Returns a monotonic timestamp in nanoseconds.
+ */
+static inline uint64_t bench_now(void){
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+}
+
+/*
+ * Returns a pseudo random number, state must not be 0.
+ */
+static inline uint64_t bench_rand(uint64_t *state){
+    uint64_t x = *state;
+    x ^= x << 13;
+    x ^= x >> 7;
+    x ^= x << 17;
+    return *state = x;
+}
+
+/*
+ * Shuffles the array of n pointers.
+ */
+static inline void bench_shuffle(void **array, size_t n, uint64_t seed){
+    for(size_t i = n; i > 1; i--){
+        size_t j = bench_rand(&seed) % i;
+        void *tmp = array[i - 1];
+        array[i - 1] = array[j];
+        array[j] = tmp;
+    }
+}
+
+static inline int _bench_cmp_u64(const void *a, const void *b){
+    uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+    return (x > y) - (x < y);
+}
+
+/*
+ * Sorts the n samples and returns the value below which pct percent of them lie.
+ */
+static inline uint64_t bench_percentile(uint64_t *samples, size_t n, double pct){
+    if(n == 0)
+        return 0;
+    qsort(samples, n, sizeof(uint64_t), _bench_cmp_u64);
+    size_t i = (size_t)(pct / 100.0 * (double)(n - 1) + 0.5);
+    return samples[i];
+}
+
+/*
+ * Keeps the compiler from optimizing away the computation of value.
+ */
+#define BENCH_USE(_value) __asm__ volatile("" : : "r"(_value) : "memory")
+
+#endif //BENCH_H
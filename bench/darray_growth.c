@@ -0,0 +1,93 @@
+/*
+   Copyright (c) 2021 Christian Döring
+   Permission is hereby granted, free of charge, to any person obtaining a copy
+   of this software and associated documentation files (the "Software"), to deal
+   in the Software without restriction, including without limitation the rights
+   to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+   copies of the Software, and to permit persons to whom the Software is
+   furnished to do so, subject to the following conditions:
+   The above copyright notice and this permission notice shall be included in all
+   copies or substantial portions of the Software.
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+   IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+   FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+   AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+   LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+   OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+   SOFTWARE.
+   */
+
+/*
+ * Growth policy benchmark of darray. Pushes 10M ints one at a time into a
+ * fresh darray and reports the best push throughput of a few runs, the number
+ * of reallocations that moved the array, the final capacity and the peak RSS
+ * of the process.
+ *
+ * The growth policy is fixed at compile time and the peak RSS is per process,
+ * so every policy is its own build of this file:
+ *
+ *   for p in "" "-DDARRAY_GROWTH_POLICY=DARRAY_GROWTH_1_5X" "-DDARRAY_USABLE_SIZE=1" \
+ *            "-DDARRAY_GROWTH_POLICY=DARRAY_GROWTH_1_5X -DDARRAY_USABLE_SIZE=1"; do
+ *       cc -O2 -std=gnu11 -I. $p bench/darray_growth.c -o darray_growth && ./darray_growth [elements]
+ *   done
+ */
+
+#include <stdio.h>
+#include <sys/resource.h>
+#include "bench/bench.h"
+#include "darray.h"
+
+#define RUNS 5
+
+#if DARRAY_GROWTH_POLICY == DARRAY_GROWTH_1_5X
+#define POLICY "1.5x"
+#else
+#define POLICY "2x"
+#endif
+
+#if DARRAY_USABLE_SIZE
+#define USABLE " usable size"
+#else
+#define USABLE ""
+#endif
+
+static long peak_rss_kib(void){
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_maxrss;
+}
+
+int main(int argc, char **argv){
+    size_t n = argc > 1 ? strtoull(argv[1], NULL, 10) : 10000000;
+    uint64_t best = UINT64_MAX;
+    size_t moves = 0, cap = 0;
+    long rss_before = peak_rss_kib();
+
+    for(int r = 0; r < RUNS; r++){
+        int *arr;
+        if(!darray_init(&arr, 1))
+            return 1;
+        size_t moved = 0;
+        uint64_t begin = bench_now();
+        for(size_t i = 0; i < n; i++){
+            int *prev = arr, v = (int)i;
+            if(!darray_push_back(&arr, &v))
+                return 1;
+            moved += arr != prev;
+        }
+        uint64_t elapsed = bench_now() - begin;
+        BENCH_USE(arr[n - 1]);
+        best = elapsed < best ? elapsed : best;
+        moves = moved;
+        cap = DARRAY_HEADER(arr)->cap / sizeof(int);
+        darray_free(&arr);
+    }
+
+    long rss = peak_rss_kib();
+    printf("policy %s%s, %zu elements\n", POLICY, USABLE, n);
+    printf("  push_back     %12.0f elements/s (%.2f ns each)\n", n / (best / 1e9), (double)best / n);
+    printf("  moves         %12zu\n", moves);
+    printf("  capacity      %12zu elements (%.1f%% unused)\n", cap, 100.0 * (cap - n) / cap);
+    printf("  peak RSS      %12ld KiB (%ld KiB above startup)\n", rss, rss - rss_before);
+    return 0;
+}
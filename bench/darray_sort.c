@@ -0,0 +1,105 @@
+/*
+   Copyright (c) 2021 Christian Döring
+   Permission is hereby granted, free of charge, to any person obtaining a copy
+   of this software and associated documentation files (the "Software"), to deal
+   in the Software without restriction, including without limitation the rights
+   to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+   copies of the Software, and to permit persons to whom the Software is
+   furnished to do so, subject to the following conditions:
+   The above copyright notice and this permission notice shall be included in all
+   copies or substantial portions of the Software.
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+   IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+   FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+   AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+   LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+   OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+   SOFTWARE.
+   */
+
+/*
+ * Scaling benchmark of the parallel merge sort from darray_sort.h. Sorts the
+ * same random uint32_t array with 1 to 64 threads and reports the best time
+ * of a few runs, the throughput and the speedup over one thread. qsort is
+ * the baseline. DARRAY_SORT_PARALLEL_THRESHOLD still applies, so small arrays
+ * use fewer threads than requested.
+ *
+ *   cc -O2 -std=gnu11 -I. -pthread bench/darray_sort.c -o darray_sort && ./darray_sort [elements]
+ */
+
+#include <stdio.h>
+
+// The thread count is read at every sort, so the benchmark can change it.
+static size_t bench_threads = 64;
+#define DARRAY_SORT_THREADS bench_threads
+
+#include "bench/bench.h"
+#include "darray_sort.h"
+
+#define RUNS 3
+
+#define u32_less(_a, _b) (*(_a) < *(_b))
+DARRAY_SORT_DEFINE(u32_sort, uint32_t, u32_less)
+
+static int u32_cmp(const void *a, const void *b){
+    uint32_t x = *(const uint32_t *)a, y = *(const uint32_t *)b;
+    return (x > y) - (x < y);
+}
+
+static void check(const uint32_t *arr, size_t n){
+    for(size_t i = 1; i < n; i++){
+        if(arr[i - 1] > arr[i]){
+            fprintf(stderr, "not sorted at %zu\n", i);
+            exit(1);
+        }
+    }
+}
+
+int main(int argc, char **argv){
+    size_t n = argc > 1 ? strtoull(argv[1], NULL, 10) : (size_t)1 << 24;
+    static const size_t threads[] = {1, 2, 4, 8, 16, 32, 64};
+    uint32_t *input = malloc(n * sizeof(uint32_t)), *arr;
+    uint64_t seed = 0x9e3779b97f4a7c15u;
+    if(input == NULL || !darray_init(&arr, n))
+        return 1;
+    for(size_t i = 0; i < n; i++)
+        input[i] = (uint32_t)bench_rand(&seed);
+    darray_append(&arr, input, n);
+
+    uint64_t best = UINT64_MAX;
+    for(int r = 0; r < RUNS; r++){
+        memcpy(arr, input, n * sizeof(uint32_t));
+        uint64_t t = bench_now();
+        qsort(arr, n, sizeof(uint32_t), u32_cmp);
+        t = bench_now() - t;
+        best = t < best ? t : best;
+    }
+    check(arr, n);
+    printf("%8s %12s %14s %8s\n", "threads", "ms", "elements/s", "speedup");
+    printf("%8s %12.2f %14.0f %8s\n", "qsort", best / 1e6, n / (best / 1e9), "-");
+
+    // The worker pool is started at the first parallel sort with the thread
+    // count at that time, so an unmeasured sort starts it with 64 threads.
+    if(!u32_sort(&arr))
+        return 1;
+    uint64_t base = 0;
+    for(size_t t = 0; t < sizeof(threads) / sizeof(*threads); t++){
+        best = UINT64_MAX;
+        for(int r = 0; r < RUNS; r++){
+            memcpy(arr, input, n * sizeof(uint32_t));
+            bench_threads = threads[t];
+            uint64_t begin = bench_now();
+            if(!u32_sort(&arr))
+                return 1;
+            uint64_t elapsed = bench_now() - begin;
+            best = elapsed < best ? elapsed : best;
+        }
+        check(arr, n);
+        base = t == 0 ? best : base;
+        printf("%8zu %12.2f %14.0f %8.2f\n", threads[t], best / 1e6, n / (best / 1e9), (double)base / best);
+    }
+
+    darray_free(&arr);
+    free(input);
+    return 0;
+}
@@ -0,0 +1,172 @@
+/*
+   Copyright (c) 2021 Christian Döring
+   Permission is hereby granted, free of charge, to any person obtaining a copy
+   of this software and associated documentation files (the "Software"), to deal
+   in the Software without restriction, including without limitation the rights
+   to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+   copies of the Software, and to permit persons to whom the Software is
+   furnished to do so, subject to the following conditions:
+   The above copyright notice and this permission notice shall be included in all
+   copies or substantial portions of the Software.
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+   IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+   FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+   AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+   LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+   OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+   SOFTWARE.
+   */
+
+/*
+ * Traversal benchmark of the prefetching dlist iterators. Visits a list whose
+ * nodes take several times the last level cache, once linked in memory order
+ * and once linked in shuffled order, and reports the best ns per node of a
+ * few passes for dlist_foreach, dlist_foreach_prefetch and
+ * dlist_foreach_batch. The list size defaults to 4 times the last level cache
+ * reported by sysconf, at least 64 MiB and at most 1 GiB.
+ *
+ * The body runs a dependent chain of multiply rounds on the value of every
+ * node, 0 rounds is a plain sum. Prefetching can only overlap the misses of
+ * the next chain with the work of the body, so every iterator is measured
+ * with bodies of increasing length.
+ *
+ *   cc -O2 -std=gnu11 -I. bench/dlist_prefetch.c -o dlist_prefetch && ./dlist_prefetch [MiB]
+ *
+ * Results on a machine with 300 MiB of last level cache, 1 GiB of nodes,
+ * shuffled layout, ns per node:
+ *
+ *   rounds   dlist_foreach   dlist_foreach_prefetch   dlist_foreach_batch
+ *        0           191.9                    194.7                 188.2
+ *       16           178.4                    197.5                 197.9
+ *       64           255.3                    174.2                 219.6
+ *      256           535.6                    379.3                1058.0
+ *
+ * Prefetching only pays off once the body takes about as long as a miss.
+ */
+
+#include <stdio.h>
+#include <unistd.h>
+#include "bench/bench.h"
+#include "dlist.h"
+
+#define RUNS 3
+#define BATCH 16
+
+static const unsigned rounds_list[] = {0, 16, 64, 256};
+static unsigned rounds;
+
+// One node per cache line, so every node visited is a separate miss.
+struct node{
+    struct dlist node;
+    uint64_t value;
+    uint8_t pad[40];
+};
+
+/*
+ * The work of the body on one node.
+ */
+static inline uint64_t work(uint64_t value){
+    for(unsigned i = 0; i < rounds; i++)
+        value = value * 0x9e3779b97f4a7c15u + i;
+    return value;
+}
+
+static uint64_t sum_plain(struct dlist *list){
+    struct dlist *iter;
+    uint64_t sum = 0;
+    dlist_foreach(iter, list)
+        sum += work(container_of(iter, struct node, node)->value);
+    return sum;
+}
+
+static uint64_t sum_prefetch(struct dlist *list){
+    struct dlist *iter;
+    uint64_t sum = 0;
+    dlist_foreach_prefetch(iter, list)
+        sum += work(container_of(iter, struct node, node)->value);
+    return sum;
+}
+
+static uint64_t sum_batch(struct dlist *list){
+    struct dlist *nodes[BATCH];
+    size_t count;
+    uint64_t sum = 0;
+    dlist_foreach_batch(nodes, count, list){
+        for(size_t i = 0; i < count; i++)
+            sum += work(container_of(nodes[i], struct node, node)->value);
+    }
+    return sum;
+}
+
+/*
+ * Links the n nodes in the order of order into list.
+ */
+static void link_nodes(struct dlist *list, struct node **order, size_t n){
+    dlist_init(list);
+    for(size_t i = 0; i < n; i++)
+        dlist_push_before(list, &order[i]->node);
+}
+
+int main(int argc, char **argv){
+    long llc = sysconf(_SC_LEVEL3_CACHE_SIZE);
+    size_t bytes = llc > 0 ? (size_t)llc * 4 : (size_t)256 << 20;
+    bytes = bytes < ((size_t)64 << 20) ? (size_t)64 << 20 : bytes > ((size_t)1 << 30) ? (size_t)1 << 30 : bytes;
+    if(argc > 1)
+        bytes = strtoull(argv[1], NULL, 10) << 20;
+    size_t n = bytes / sizeof(struct node);
+
+    struct node *nodes = malloc(n * sizeof(struct node));
+    struct node **order = malloc(n * sizeof(struct node *));
+    if(nodes == NULL || order == NULL)
+        return 1;
+    for(size_t i = 0; i < n; i++){
+        nodes[i].value = i;
+        order[i] = &nodes[i];
+    }
+
+    static const struct{
+        const char *name;
+        uint64_t (*sum)(struct dlist *);
+    } cases[] = {
+        {"dlist_foreach", sum_plain},
+        {"dlist_foreach_prefetch", sum_prefetch},
+        {"dlist_foreach_batch", sum_batch},
+    };
+
+    printf("%zu nodes, %zu MiB, last level cache %ld KiB\n", n, n * sizeof(struct node) >> 20, llc >> 10);
+    printf("%-24s %8s %14s %14s\n", "", "rounds", "sequential ns", "shuffled ns");
+    double result[sizeof(rounds_list) / sizeof(*rounds_list)][3][2];
+    struct dlist list;
+    for(int layout = 0; layout < 2; layout++){
+        if(layout == 1)
+            bench_shuffle((void **)order, n, 0x9e3779b97f4a7c15u);
+        link_nodes(&list, order, n);
+        for(size_t w = 0; w < sizeof(rounds_list) / sizeof(*rounds_list); w++){
+            rounds = rounds_list[w];
+            uint64_t expect = 0;
+            for(size_t i = 0; i < n; i++)
+                expect += work(nodes[i].value);
+            for(size_t c = 0; c < sizeof(cases) / sizeof(*cases); c++){
+                uint64_t best = UINT64_MAX;
+                for(int r = 0; r < RUNS; r++){
+                    uint64_t begin = bench_now();
+                    uint64_t sum = cases[c].sum(&list);
+                    uint64_t elapsed = bench_now() - begin;
+                    if(sum != expect){
+                        fprintf(stderr, "%s: wrong sum\n", cases[c].name);
+                        return 1;
+                    }
+                    best = elapsed < best ? elapsed : best;
+                }
+                result[w][c][layout] = (double)best / n;
+            }
+        }
+    }
+    for(size_t w = 0; w < sizeof(rounds_list) / sizeof(*rounds_list); w++)
+        for(size_t c = 0; c < sizeof(cases) / sizeof(*cases); c++)
+            printf("%-24s %8u %14.2f %14.2f\n", cases[c].name, rounds_list[w], result[w][c][0], result[w][c][1]);
+
+    free(order);
+    free(nodes);
+    return 0;
+}
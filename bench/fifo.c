@@ -0,0 +1,105 @@
+/*
+   Copyright (c) 2021 Christian Döring
+   Permission is hereby granted, free of charge, to any person obtaining a copy
+   of this software and associated documentation files (the "Software"), to deal
+   in the Software without restriction, including without limitation the rights
+   to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+   copies of the Software, and to permit persons to whom the Software is
+   furnished to do so, subject to the following conditions:
+   The above copyright notice and this permission notice shall be included in all
+   copies or substantial portions of the Software.
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+   IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+   FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+   AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+   LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+   OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+   SOFTWARE.
+   */
+
+/*
+ * Copy benchmark of fifo_write and fifo_read. Every record is written and
+ * read back through a ring whose size is not a multiple of the record size,
+ * so records keep wrapping around at different offsets. The memcpy based
+ * copy of fifo.h is compared with the per byte modulo loop it replaced,
+ * for record sizes from 1 B to 64 KiB.
+ *
+ *   cc -O2 -std=gnu11 -I. bench/fifo.c -o fifo && ./fifo [MiB per record size]
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include "bench/bench.h"
+#include "fifo.h"
+
+#define RING_SIZE (((size_t)1 << 20) + 61)
+#define MAX_RECORD ((size_t)1 << 16)
+
+/*
+ * The byte loop fifo_write and fifo_read used before the memcpy copy.
+ */
+static int byte_write(struct fifo *self, const void *src, size_t size){
+    if(size >= self->size - fifo_size(self))
+        return 0;
+    for(size_t i = 0; i < size; i++)
+        self->data[(self->head + i) % self->size] = ((const uint8_t *)src)[i];
+    self->head = (self->head + size) % self->size;
+    return 1;
+}
+
+static int byte_read(struct fifo *self, void *dst, size_t size){
+    if(fifo_size(self) < size)
+        return 0;
+    for(size_t i = 0; i < size; i++)
+        ((uint8_t *)dst)[i] = self->data[(self->tail + i) % self->size];
+    self->tail = (self->tail + size) % self->size;
+    return 1;
+}
+
+/*
+ * Writes and reads back records of record bytes until total bytes went through
+ * the fifo and returns the elapsed time. Four records are kept in flight.
+ */
+static uint64_t run(int (*write)(struct fifo *, const void *, size_t), int (*read)(struct fifo *, void *, size_t),
+        struct fifo *f, uint8_t *src, uint8_t *dst, size_t record, size_t total){
+    size_t records = total / record;
+    f->head = f->tail = 0;
+    uint64_t begin = bench_now();
+    for(size_t i = 0; i < 4; i++)
+        write(f, src, record);
+    for(size_t i = 0; i < records; i++){
+        read(f, dst, record);
+        write(f, src, record);
+        BENCH_USE(dst[record - 1]);
+    }
+    return bench_now() - begin;
+}
+
+int main(int argc, char **argv){
+    size_t total = (argc > 1 ? strtoull(argv[1], NULL, 10) : 256) << 20;
+    uint8_t *ring = malloc(RING_SIZE), *src = malloc(MAX_RECORD), *dst = malloc(MAX_RECORD);
+    struct fifo f;
+    if(ring == NULL || src == NULL || dst == NULL || fifo_init(&f, ring, RING_SIZE) == NULL)
+        return 1;
+    for(size_t i = 0; i < MAX_RECORD; i++)
+        src[i] = (uint8_t)i;
+
+    printf("%8s %12s %12s %8s\n", "record", "memcpy GB/s", "byte GB/s", "speedup");
+    for(size_t record = 1; record <= MAX_RECORD; record *= 4){
+        // Tiny records run fewer bytes, the byte loop is slow enough as it is.
+        size_t bytes = record < 64 ? total / 16 : total;
+        uint64_t t_memcpy = run(fifo_write, fifo_read, &f, src, dst, record, bytes);
+        uint64_t t_byte = run(byte_write, byte_read, &f, src, dst, record, bytes);
+        if(memcmp(src, dst, record) != 0){
+            fprintf(stderr, "record %zu corrupted\n", record);
+            return 1;
+        }
+        printf("%8zu %12.2f %12.2f %8.2f\n", record, bytes / (double)t_memcpy, bytes / (double)t_byte,
+                (double)t_byte / t_memcpy);
+    }
+
+    free(dst);
+    free(src);
+    free(ring);
+    return 0;
+}
@@ -0,0 +1,144 @@
+/*
+   Copyright (c) 2021 Christian Döring
+   Permission is hereby granted, free of charge, to any person obtaining a copy
+   of this software and associated documentation files (the "Software"), to deal
+   in the Software without restriction, including without limitation the rights
+   to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+   copies of the Software, and to permit persons to whom the Software is
+   furnished to do so, subject to the following conditions:
+   The above copyright notice and this permission notice shall be included in all
+   copies or substantial portions of the Software.
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+   IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+   FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+   AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+   LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+   OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+   SOFTWARE.
+   */
+
+/*
+ * Push benchmark of the MDARRAY_APPEND fast path. Appends n ints one at a
+ * time and reports the best throughput of a few runs, both into a fresh
+ * array that has to grow and into one reserved up front. The comparisons:
+ *
+ *   MDARRAY_INSERT     the generic insert path appends used before
+ *   darray_push_back   darray.h
+ *   vector             a plain malloc/realloc array that doubles, the way
+ *                      std::vector grows (std::vector itself is C++ and
+ *                      is not part of these C benchmarks)
+ *
+ *   cc -O2 -std=gnu11 -I. bench/mdarray.c -o mdarray && ./mdarray [elements]
+ */
+
+#include <stdio.h>
+#include "bench/bench.h"
+#include "mdarray.h"
+#include "darray.h"
+
+#define RUNS 5
+
+struct vector{
+    int *data;
+    size_t size, cap;
+};
+
+static inline int vector_push_back(struct vector *v, int elem){
+    if(v->size == v->cap){
+        size_t cap = v->cap ? v->cap * 2 : 1;
+        int *data = realloc(v->data, cap * sizeof(int));
+        if(data == NULL)
+            return 0;
+        v->data = data;
+        v->cap = cap;
+    }
+    v->data[v->size++] = elem;
+    return 1;
+}
+
+static uint64_t run_mdarray_append(size_t n, int reserve){
+    MDARRAY(int) arr;
+    if(MDARRAY_INIT(arr) == NULL || (reserve && !MDARRAY_RESERVE(arr, n)))
+        exit(1);
+    uint64_t begin = bench_now();
+    for(size_t i = 0; i < n; i++)
+        if(!MDARRAY_APPEND(arr, (int)i))
+            exit(1);
+    uint64_t elapsed = bench_now() - begin;
+    BENCH_USE(arr[n - 1]);
+    MDARRAY_FREE(arr);
+    return elapsed;
+}
+
+static uint64_t run_mdarray_insert(size_t n, int reserve){
+    MDARRAY(int) arr;
+    if(MDARRAY_INIT(arr) == NULL || (reserve && !MDARRAY_RESERVE(arr, n)))
+        exit(1);
+    uint64_t begin = bench_now();
+    for(size_t i = 0; i < n; i++){
+        int v = (int)i;
+        if(!MDARRAY_INSERT(arr, &v, i))
+            exit(1);
+    }
+    uint64_t elapsed = bench_now() - begin;
+    BENCH_USE(arr[n - 1]);
+    MDARRAY_FREE(arr);
+    return elapsed;
+}
+
+static uint64_t run_darray(size_t n, int reserve){
+    int *arr;
+    if(!darray_init(&arr, reserve ? n : 1))
+        exit(1);
+    uint64_t begin = bench_now();
+    for(size_t i = 0; i < n; i++){
+        int v = (int)i;
+        if(!darray_push_back(&arr, &v))
+            exit(1);
+    }
+    uint64_t elapsed = bench_now() - begin;
+    BENCH_USE(arr[n - 1]);
+    darray_free(&arr);
+    return elapsed;
+}
+
+static uint64_t run_vector(size_t n, int reserve){
+    struct vector v = {0};
+    if(reserve && (v.data = malloc(n * sizeof(int))) == NULL)
+        exit(1);
+    v.cap = reserve ? n : 0;
+    uint64_t begin = bench_now();
+    for(size_t i = 0; i < n; i++)
+        if(!vector_push_back(&v, (int)i))
+            exit(1);
+    uint64_t elapsed = bench_now() - begin;
+    BENCH_USE(v.data[n - 1]);
+    free(v.data);
+    return elapsed;
+}
+
+int main(int argc, char **argv){
+    size_t n = argc > 1 ? strtoull(argv[1], NULL, 10) : 10000000;
+    static const struct{
+        const char *name;
+        uint64_t (*run)(size_t, int);
+    } cases[] = {
+        {"MDARRAY_APPEND", run_mdarray_append},
+        {"MDARRAY_INSERT", run_mdarray_insert},
+        {"darray_push_back", run_darray},
+        {"vector", run_vector},
+    };
+
+    printf("%-18s %16s %16s\n", "", "grow elem/s", "reserved elem/s");
+    for(size_t c = 0; c < sizeof(cases) / sizeof(*cases); c++){
+        uint64_t best[2] = {UINT64_MAX, UINT64_MAX};
+        for(int reserve = 0; reserve < 2; reserve++){
+            for(int r = 0; r < RUNS; r++){
+                uint64_t t = cases[c].run(n, reserve);
+                best[reserve] = t < best[reserve] ? t : best[reserve];
+            }
+        }
+        printf("%-18s %16.0f %16.0f\n", cases[c].name, n / (best[0] / 1e9), n / (best[1] / 1e9));
+    }
+    return 0;
+}
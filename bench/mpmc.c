@@ -0,0 +1,112 @@
+/*
+   Copyright (c) 2021 Christian Döring
+   Permission is hereby granted, free of charge, to any person obtaining a copy
+   of this software and associated documentation files (the "Software"), to deal
+   in the Software without restriction, including without limitation the rights
+   to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+   copies of the Software, and to permit persons to whom the Software is
+   furnished to do so, subject to the following conditions:
+   The above copyright notice and this permission notice shall be included in all
+   copies or substantial portions of the Software.
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+   IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+   FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+   AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+   LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+   OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+   SOFTWARE.
+   */
+
+
+/*
+ * Contention benchmark of struct mpmc. Every thread pushes and pops in turn,
+ * so all threads contend on both position counters. Reports the throughput
+ * and the median and p99 latency of a push/pop pair for 1 to 64 threads.
+ *
+ *   cc -O2 -std=gnu11 -I. -pthread bench/mpmc.c -o mpmc && ./mpmc [pairs per thread]
+ */
+
+#include <stdio.h>
+#include <pthread.h>
+#include "bench/bench.h"
+#include "mpmc.h"
+
+#define SAMPLE_EVERY 16
+
+struct worker{
+    pthread_t thread;
+    struct mpmc *q;
+    pthread_barrier_t *start;
+    size_t pairs;
+    uint64_t *samples;
+    size_t samples_n;
+    uint64_t begin, end;
+};
+
+static void *worker_run(void *arg){
+    struct worker *w = arg;
+    uint64_t v = 0, t = 0;
+    pthread_barrier_wait(w->start);
+    w->begin = bench_now();
+    for(size_t i = 0; i < w->pairs; i++){
+        int sample = i % SAMPLE_EVERY == 0;
+        if(sample)
+            t = bench_now();
+        while(!mpmc_push(w->q, &v))
+            ;
+        while(!mpmc_pop(w->q, &v))
+            ;
+        if(sample)
+            w->samples[w->samples_n++] = bench_now() - t;
+        v++;
+    }
+    w->end = bench_now();
+    return NULL;
+}
+
+int main(int argc, char **argv){
+    size_t pairs = argc > 1 ? strtoull(argv[1], NULL, 10) : 200000;
+    static const size_t threads[] = {1, 2, 4, 8, 16, 32, 64};
+
+    printf("%8s %14s %10s %10s\n", "threads", "ops/s", "p50 ns", "p99 ns");
+    for(size_t t = 0; t < sizeof(threads) / sizeof(*threads); t++){
+        size_t n = threads[t];
+        struct mpmc q;
+        struct worker w[64];
+        pthread_barrier_t start;
+        if(mpmc_init(&q, uint64_t, 1024) == NULL)
+            return 1;
+        pthread_barrier_init(&start, NULL, n + 1);
+
+        size_t per_thread = pairs / SAMPLE_EVERY + 1;
+        uint64_t *samples = malloc(n * per_thread * sizeof(uint64_t));
+        for(size_t i = 0; i < n; i++){
+            w[i] = (struct worker){.q = &q, .start = &start, .pairs = pairs, .samples = samples + i * per_thread};
+            pthread_create(&w[i].thread, NULL, worker_run, &w[i]);
+        }
+        pthread_barrier_wait(&start);
+        uint64_t begin = UINT64_MAX, end = 0;
+        for(size_t i = 0; i < n; i++){
+            pthread_join(w[i].thread, NULL);
+            begin = w[i].begin < begin ? w[i].begin : begin;
+            end = w[i].end > end ? w[i].end : end;
+        }
+        uint64_t elapsed = end - begin;
+
+        // Compact the samples of all threads for the percentiles.
+        size_t samples_n = 0;
+        for(size_t i = 0; i < n; i++){
+            memmove(samples + samples_n, w[i].samples, w[i].samples_n * sizeof(uint64_t));
+            samples_n += w[i].samples_n;
+        }
+        double ops = 2.0 * (double)pairs * (double)n / ((double)elapsed / 1e9);
+        uint64_t p50 = bench_percentile(samples, samples_n, 50);
+        uint64_t p99 = bench_percentile(samples, samples_n, 99);
+        printf("%8zu %14.0f %10llu %10llu\n", n, ops, (unsigned long long)p50, (unsigned long long)p99);
+
+        free(samples);
+        pthread_barrier_destroy(&start);
+        mpmc_free(&q);
+    }
+    return 0;
+}
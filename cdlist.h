@@ -0,0 +1,442 @@
+/*
+   Copyright (c) 2021 Christian Döring
+   Permission is hereby granted, free of charge, to any person obtaining a copy
+   of this software and associated documentation files (the "Software"), to deal
+   in the Software without restriction, including without limitation the rights
+   to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+   copies of the Software, and to permit persons to whom the Software is
+   furnished to do so, subject to the following conditions:
+   The above copyright notice and this permission notice shall be included in all
+   copies or substantial portions of the Software.
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+   IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+   FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+   AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+   LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+   OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+   SOFTWARE.
+   */
+
+#ifndef CDLIST_H
+#define CDLIST_H
+
+#include <stddef.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include <sched.h>
+
+#ifndef container_of
+#define container_of(_ptr, _type, _member) ((_type *)((char*)(_ptr)-(char*)(&((_type*)0)->_member)))
+#endif
+
+/*
+ * Cdlist is a cyclic doubly linked list for concurrent use.
+ *
+ * Readers traverse the list forward without taking any lock. Writers lock
+ * only the nodes whose pointers they change: inserting after a node locks
+ * it and its successor, removing a node locks its predecessor, the node and
+ * its successor. Locks are taken in list order; every lock after the first
+ * one is only tried, on failure all locks are released and the writer backs
+ * off, so two writers wrapping around the head can not deadlock.
+ *
+ * A removed node keeps its next pointer, so a reader standing on it still
+ * finds the rest of the list. Its memory must not be reused while a reader
+ * may still stand on it, which is what struct cdlist_epoch takes care of
+ * (epoch based reclamation):
+ *
+ * - Every reader thread owns a struct cdlist_reader and encloses each
+ *   traversal in cdlist_read_lock and cdlist_read_unlock. The reader
+ *   announces the global epoch it started in.
+ * - Removed nodes are handed to cdlist_retire, which puts them on the limbo
+ *   list of the current global epoch.
+ * - The global epoch only advances once every active reader announced it.
+ *   When it advances to e + 1 the nodes retired in e - 2 can not be seen by
+ *   any reader anymore and are passed to the free function.
+ *
+ * Writers have to hold a read lock as well while they use nodes they found in
+ * the list (the node passed to cdlist_pop or cdlist_push_after, and the last
+ * node in cdlist_push_back).
+ *
+ * Usage example:
+ *
+ *   struct sub{
+ *       struct cdlist node;
+ *       int fd;
+ *   };
+ *
+ *   static void sub_free(struct cdlist *node){
+ *       free(container_of(node, struct sub, node));
+ *   }
+ *
+ *   struct cdlist list;
+ *   struct cdlist_epoch epoch;
+ *   cdlist_init(&list);
+ *   cdlist_epoch_init(&epoch, sub_free);
+ *
+ *   // every thread
+ *   struct cdlist_reader *reader = cdlist_reader_register(&epoch);
+ *   struct sub *s;
+ *
+ *   cdlist_read_lock(reader);
+ *   cdlist_foreach_cont(s, &list, node){
+ *       if(s->fd == fd && cdlist_pop(&s->node) != NULL)
+ *           cdlist_retire(&epoch, &s->node);
+ *   }
+ *   cdlist_read_unlock(reader);
+ *
+ *   cdlist_reader_unregister(reader);
+ */
+
+/*
+ * Maximum number of registered readers of a struct cdlist_epoch.
+ */
+#ifndef CDLIST_MAX_READERS
+#define CDLIST_MAX_READERS 64
+#endif
+
+/*
+ * Number of retired nodes after which cdlist_retire tries to advance the epoch.
+ */
+#ifndef CDLIST_RECLAIM_THRESHOLD
+#define CDLIST_RECLAIM_THRESHOLD 64
+#endif
+
+#ifndef CDLIST_CACHELINE
+#define CDLIST_CACHELINE 64
+#endif
+
+/*
+ * Iterate over the list (inside cdlist_read_lock).
+ *
+ * @param _iter_p: pointer to the current node
+ * @param _list_p: pointer to the head of the list
+ */
+#define cdlist_foreach(_iter_p, _list_p)\
+    for((_iter_p) = __atomic_load_n(&(_list_p)->next, __ATOMIC_ACQUIRE);\
+        (_iter_p) != (_list_p);\
+        (_iter_p) = __atomic_load_n(&(_iter_p)->next, __ATOMIC_ACQUIRE))
+
+/*
+ * Iterate over the containers of the list (inside cdlist_read_lock).
+ *
+ * @param _iter_p: pointer to the current container
+ * @param _list_p: pointer to the head of the list
+ * @param _member: name of the struct cdlist in the container
+ */
+#define cdlist_foreach_cont(_iter_p, _list_p, _member)\
+    for((_iter_p) = container_of(__atomic_load_n(&(_list_p)->next, __ATOMIC_ACQUIRE), typeof(*(_iter_p)), _member);\
+        &((_iter_p)->_member) != (_list_p);\
+        (_iter_p) = container_of(__atomic_load_n(&(_iter_p)->_member.next, __ATOMIC_ACQUIRE), typeof(*(_iter_p)), _member))
+
+/*
+ * cdlist is the node as well as the head of a concurrent doubly linked list.
+ *
+ * @param retired: links the node on a limbo list after it has been retired
+ * @param lock: spin lock of the node
+ * @param deleted: set once the node has been removed from the list
+ */
+struct cdlist{
+    struct cdlist *next, *prev;
+    struct cdlist *retired;
+    _Atomic(int) lock;
+    int deleted;
+};
+
+/*
+ * Reader slot of a struct cdlist_epoch, state is (epoch << 1) | active.
+ */
+struct cdlist_reader{
+    _Alignas(CDLIST_CACHELINE) _Atomic(size_t) state;
+    _Atomic(int) used;
+    struct cdlist_epoch *epoch;
+};
+
+struct cdlist_epoch{
+    _Atomic(size_t) global;
+    pthread_mutex_t lock;
+    struct cdlist *limbo[3];
+    size_t retired;
+    void (*free)(struct cdlist *node);
+    struct cdlist_reader readers[CDLIST_MAX_READERS];
+};
+
+/*
+ * cdlist_init initializes list (next = prev = self)
+ *
+ * @param dst: pointer to the node
+ * @return: dst
+ */
+static inline struct cdlist *cdlist_init(struct cdlist *dst){
+    dst->next = dst;
+    dst->prev = dst;
+    dst->retired = NULL;
+    atomic_init(&dst->lock, 0);
+    dst->deleted = 0;
+    return dst;
+}
+
+/*
+ * Internal function locking a node.
+ */
+static inline void _cdlist_lock(struct cdlist *node){
+    while(atomic_exchange_explicit(&node->lock, 1, memory_order_acquire)){
+        while(atomic_load_explicit(&node->lock, memory_order_relaxed))
+            sched_yield();
+    }
+}
+
+/*
+ * Internal function trying to lock a node.
+ *
+ * @return 1 if locked, 0 else
+ */
+static inline int _cdlist_trylock(struct cdlist *node){
+    return !atomic_exchange_explicit(&node->lock, 1, memory_order_acquire);
+}
+
+static inline void _cdlist_unlock(struct cdlist *node){
+    atomic_store_explicit(&node->lock, 0, memory_order_release);
+}
+
+/*
+ * Internal function pushing src after dst, if dst has not been removed and
+ * (unless next is NULL) dst->next is still next.
+ *
+ * @return src if success, NULL else
+ */
+static inline struct cdlist *_cdlist_push_after(struct cdlist *dst, struct cdlist *src, struct cdlist *next){
+    struct cdlist *expect = next;
+    for(;;){
+        _cdlist_lock(dst);
+        next = dst->next;
+        if(dst->deleted || (expect != NULL && next != expect)){
+            _cdlist_unlock(dst);
+            return NULL;
+        }
+        if(next == dst || _cdlist_trylock(next))
+            break;
+        _cdlist_unlock(dst);
+        sched_yield();
+    }
+    src->next = next;
+    src->prev = dst;
+    src->retired = NULL;
+    atomic_init(&src->lock, 0);
+    src->deleted = 0;
+    // publishing src in dst->next makes it visible to readers.
+    __atomic_store_n(&dst->next, src, __ATOMIC_RELEASE);
+    __atomic_store_n(&next->prev, src, __ATOMIC_RELEASE);
+    if(next != dst)
+        _cdlist_unlock(next);
+    _cdlist_unlock(dst);
+    return src;
+}
+
+/*
+ * cdlist_push_after pushes src after the dst node in the list
+ *
+ * @param dst: node after which to push src
+ * @param src: node to push, it is initialized by this function
+ * @return src if success, NULL if dst has been removed
+ */
+static inline struct cdlist *cdlist_push_after(struct cdlist *dst, struct cdlist *src){
+    return _cdlist_push_after(dst, src, NULL);
+}
+
+/*
+ * cdlist_push_front pushes src at the front of the list
+ *
+ * @return src
+ */
+static inline struct cdlist *cdlist_push_front(struct cdlist *self, struct cdlist *src){
+    return cdlist_push_after(self, src);
+}
+
+/*
+ * cdlist_push_back pushes src at the back of the list
+ *
+ * Locks the current last node, so it has to be called inside a read lock.
+ *
+ * @return src
+ */
+static inline struct cdlist *cdlist_push_back(struct cdlist *self, struct cdlist *src){
+    for(;;){
+        struct cdlist *last = __atomic_load_n(&self->prev, __ATOMIC_ACQUIRE);
+        // Fails if last was removed or is not the last node anymore, then the new last node is used.
+        if(_cdlist_push_after(last, src, self) != NULL)
+            return src;
+        sched_yield();
+    }
+}
+
+/*
+ * cdlist_pop removes target from the list. Readers may still traverse
+ * target, it has to be passed to cdlist_retire instead of being freed.
+ *
+ * @param target: node to remove, must not be the head
+ * @return target if success, NULL if target has already been removed
+ */
+static inline struct cdlist *cdlist_pop(struct cdlist *target){
+    struct cdlist *prev, *next;
+    for(;;){
+        if(__atomic_load_n(&target->deleted, __ATOMIC_ACQUIRE))
+            return NULL;
+        prev = __atomic_load_n(&target->prev, __ATOMIC_ACQUIRE);
+        _cdlist_lock(prev);
+        if(prev->deleted || prev->next != target){
+            // prev was removed or a node was inserted between prev and target.
+            _cdlist_unlock(prev);
+            continue;
+        }
+        if(_cdlist_trylock(target)){
+            next = target->next;
+            if(next == prev || _cdlist_trylock(next))
+                break;
+            _cdlist_unlock(target);
+        }
+        _cdlist_unlock(prev);
+        sched_yield();
+    }
+    __atomic_store_n(&prev->next, next, __ATOMIC_RELEASE);
+    __atomic_store_n(&next->prev, prev, __ATOMIC_RELEASE);
+    __atomic_store_n(&target->deleted, 1, __ATOMIC_RELEASE);
+    if(next != prev)
+        _cdlist_unlock(next);
+    _cdlist_unlock(target);
+    _cdlist_unlock(prev);
+    return target;
+}
+
+/*
+ * Initializes the reclamation domain.
+ *
+ * @param free: called for every retired node once no reader can see it
+ * @return self, NULL if failed
+ */
+static inline struct cdlist_epoch *cdlist_epoch_init(struct cdlist_epoch *self, void (*free)(struct cdlist *node)){
+    atomic_init(&self->global, 0);
+    self->limbo[0] = self->limbo[1] = self->limbo[2] = NULL;
+    self->retired = 0;
+    self->free = free;
+    for(size_t i = 0; i < CDLIST_MAX_READERS; i++){
+        atomic_init(&self->readers[i].state, 0);
+        atomic_init(&self->readers[i].used, 0);
+        self->readers[i].epoch = self;
+    }
+    if(pthread_mutex_init(&self->lock, NULL) != 0)
+        return NULL;
+    return self;
+}
+
+/*
+ * Claims a reader slot for the calling thread.
+ *
+ * @return the reader, NULL if all CDLIST_MAX_READERS slots are in use
+ */
+static inline struct cdlist_reader *cdlist_reader_register(struct cdlist_epoch *self){
+    for(size_t i = 0; i < CDLIST_MAX_READERS; i++){
+        int used = 0;
+        if(atomic_compare_exchange_strong(&self->readers[i].used, &used, 1))
+            return &self->readers[i];
+    }
+    return NULL;
+}
+
+/*
+ * Gives the reader slot back. The reader must not be inside a read lock.
+ */
+static inline void cdlist_reader_unregister(struct cdlist_reader *reader){
+    atomic_store_explicit(&reader->state, 0, memory_order_release);
+    atomic_store_explicit(&reader->used, 0, memory_order_release);
+}
+
+/*
+ * Starts a traversal. Read locks of one reader do not nest.
+ */
+static inline void cdlist_read_lock(struct cdlist_reader *reader){
+    size_t epoch = atomic_load_explicit(&reader->epoch->global, memory_order_relaxed);
+    atomic_store_explicit(&reader->state, (epoch << 1) | 1, memory_order_relaxed);
+    // The announcement has to be visible before any node of the list is read.
+    atomic_thread_fence(memory_order_seq_cst);
+}
+
+/*
+ * Ends a traversal. Nodes found during it must not be used afterwards.
+ */
+static inline void cdlist_read_unlock(struct cdlist_reader *reader){
+    atomic_store_explicit(&reader->state, 0, memory_order_release);
+}
+
+/*
+ * Internal function freeing the nodes of a limbo list.
+ */
+static inline void _cdlist_free_limbo(struct cdlist_epoch *self, struct cdlist *node){
+    struct cdlist *next;
+    for(; node != NULL; node = next){
+        next = node->retired;
+        self->free(node);
+    }
+}
+
+/*
+ * Internal function advancing the global epoch if every active reader
+ * announced it. self->lock has to be held.
+ *
+ * @return the limbo list that became safe to free, NULL if the epoch did not advance
+ */
+static inline struct cdlist *_cdlist_advance(struct cdlist_epoch *self){
+    size_t epoch = atomic_load_explicit(&self->global, memory_order_relaxed);
+    atomic_thread_fence(memory_order_seq_cst);
+    for(size_t i = 0; i < CDLIST_MAX_READERS; i++){
+        size_t state = atomic_load_explicit(&self->readers[i].state, memory_order_acquire);
+        if((state & 1) && (state >> 1) != epoch)
+            return NULL;
+    }
+    struct cdlist *safe = self->limbo[(epoch + 1) % 3];
+    self->limbo[(epoch + 1) % 3] = NULL;
+    atomic_store_explicit(&self->global, epoch + 1, memory_order_release);
+    return safe;
+}
+
+/*
+ * Tries to advance the epoch and frees the nodes that became safe.
+ * Does not wait for readers.
+ */
+static inline void cdlist_reclaim(struct cdlist_epoch *self){
+    struct cdlist *safe;
+    pthread_mutex_lock(&self->lock);
+    safe = _cdlist_advance(self);
+    pthread_mutex_unlock(&self->lock);
+    _cdlist_free_limbo(self, safe);
+}
+
+/*
+ * Hands a node removed with cdlist_pop to the reclamation domain. The node is
+ * freed once no reader can see it anymore.
+ */
+static inline void cdlist_retire(struct cdlist_epoch *self, struct cdlist *node){
+    struct cdlist *safe = NULL;
+    pthread_mutex_lock(&self->lock);
+    size_t epoch = atomic_load_explicit(&self->global, memory_order_relaxed);
+    node->retired = self->limbo[epoch % 3];
+    self->limbo[epoch % 3] = node;
+    if(++self->retired >= CDLIST_RECLAIM_THRESHOLD){
+        self->retired = 0;
+        safe = _cdlist_advance(self);
+    }
+    pthread_mutex_unlock(&self->lock);
+    _cdlist_free_limbo(self, safe);
+}
+
+/*
+ * Frees all retired nodes. No reader may be inside a read lock.
+ */
+static inline void cdlist_epoch_free(struct cdlist_epoch *self){
+    for(size_t i = 0; i < 3; i++){
+        _cdlist_free_limbo(self, self->limbo[i]);
+        self->limbo[i] = NULL;
+    }
+    pthread_mutex_destroy(&self->lock);
+}
+
+#endif //CDLIST_H
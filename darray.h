@@ -82,15 +82,80 @@ SOFTWARE.
 
 /*
  * Definitions of realloc, malloc, free for darray (can be changed to custom allocator)
+ * They are used by every darray that was not initialized with darray_init_allocator.
  */
 #define DARRAY_REALLOC(_void_p, _size) realloc(_void_p, _size)
 #define DARRAY_MALLOC(_void_p) malloc(_void_p)
 #define DARRAY_FREE(_void_p) free(_void_p)
 
 /*
- * Growth factor of the darray (not yet tested)
+ * Allocator that can be attached to a single darray with darray_init_allocator.
+ * The darray keeps a pointer to it, so it has to outlive the darray.
+ *
+ * All sizes include the darray_header. old_size and size passed to free are
+ * the sizes that were requested for the block, which allows allocators
+ * without per block bookkeeping (arenas, bump allocators).
+ *
+ * @param alloc_fn: allocates a new block of size bytes. May be NULL if the
+ *                  allocator can only resize its block (e.g. a single mapping),
+ *                  darray then only uses realloc_fn.
+ * @param realloc_fn: resizes the block at ptr from old_size to size bytes.
+ * @param free_fn: frees the block at ptr. May do nothing, e.g. if the memory
+ *                 is released at once by resetting an arena.
+ * @param ctx: passed to every function.
+ * @param flags: DARRAY_ALLOC_* flags of the allocator.
+ * @param remap_min: with DARRAY_ALLOC_REMAP, the smallest block size that
+ *                   realloc_fn resizes without copying.
  */
-#define DARRAY_GROWTH_FACTOR 2
+struct darray_allocator{
+    void *(*alloc_fn)(void *ctx, size_t size);
+    void *(*realloc_fn)(void *ctx, void *ptr, size_t old_size, size_t size);
+    void (*free_fn)(void *ctx, void *ptr, size_t size);
+    void *ctx;
+    size_t flags, remap_min;
+};
+
+/*
+ * Flags of struct darray_allocator.
+ *
+ * DARRAY_ALLOC_REMAP: realloc_fn resizes blocks of at least remap_min bytes
+ *                     without copying them (e.g. with mremap). Inserting
+ *                     into the middle of such a block then grows it with
+ *                     realloc_fn and moves only the elements after the
+ *                     index, instead of copying the whole array into a new
+ *                     block from alloc_fn.
+ */
+#define DARRAY_ALLOC_REMAP 0x1
+
+/*
+ * Growth policies of the darray.
+ *
+ * DARRAY_GROWTH_2X:   capacity is the next power of two bigger than the size.
+ * DARRAY_GROWTH_1_5X: capacity grows by half of the current capacity.
+ */
+#define DARRAY_GROWTH_2X 0
+#define DARRAY_GROWTH_1_5X 1
+
+/*
+ * Growth policy used by all darrays (DARRAY_GROWTH_2X or DARRAY_GROWTH_1_5X).
+ */
+#ifndef DARRAY_GROWTH_POLICY
+#define DARRAY_GROWTH_POLICY DARRAY_GROWTH_2X
+#endif
+
+/*
+ * If DARRAY_USABLE_SIZE is 1 the capacity stored in darray_header is the
+ * usable size reported by malloc_usable_size instead of the requested one,
+ * so the slack of the allocators size class is used before the next realloc.
+ * Only valid if DARRAY_MALLOC and DARRAY_REALLOC are malloc and realloc.
+ */
+#ifndef DARRAY_USABLE_SIZE
+#define DARRAY_USABLE_SIZE 0
+#endif
+
+#if DARRAY_USABLE_SIZE
+#include <malloc.h>
+#endif
 
 /*
  * Defines how much smaller the calculated capacity has to be to 
@@ -99,25 +164,37 @@ SOFTWARE.
  *
  * example: DARRAY_SHRINK_FACTOR = 2, header->size = 36, header->cap = 128, size = 4
  *          darray shrinks when cap < header->cap / DARRAY_SHRINK_FACTOR 
- *          cap = _darray_ciellog2(header->size - size) = 32
+ *          cap = _darray_capacity(0, header->size - size) = 32
  *          => array shrinks.
  *
  *          (array shrinks when cap is smaller than 1/(DARRAY_SHRINK_FACTOR * 2) of header->cap)
  */
 #define DARRAY_SHRINK_FACTOR 2
 
+/*
+ * Flags stored in darray_header.
+ *
+ * DARRAY_NOSHRINK: removing elements never reallocates the array.
+ * DARRAY_INLINE: header and data live in caller provided storage (see darray_init_inline).
+ */
+#define DARRAY_NOSHRINK 0x1
+#define DARRAY_INLINE 0x2
+
 /*
  * Header structure of darray keeps track of the size and cap.
  *
  * @param align: uintmax_t for guarantueeing allignment of header[1] if sizeof(size_t) < sizeof(uintmax_t)
  * @param size: Stores the size of the darray
  * @param cap: Stores curent maximum capacity.
+ * @param flags: Stores DARRAY_* flags of the darray.
+ * @param allocator: Stores the allocator of the darray (NULL for DARRAY_MALLOC etc.)
  */
 struct darray_header{
     union{
         uintmax_t align;
         struct{
-            size_t size, cap;
+            size_t size, cap, flags;
+            const struct darray_allocator *allocator;
         };
     };
 };
@@ -142,7 +219,62 @@ struct darray_header{
  *
  * @return pointer to the header of the array (NULL if failed)
  */
-#define darray_init(_arr_p, _cap) _darray_init((void **)(_arr_p), (_cap) * sizeof(**(_arr_p)))
+#define darray_init(_arr_p, _cap) _darray_init((void **)(_arr_p), (_cap) * sizeof(**(_arr_p)), NULL)
+
+/*
+ * Function to initialize the darray with its own allocator.
+ *
+ * All memory of the darray is (re)allocated and freed through _allocator
+ * instead of DARRAY_MALLOC, DARRAY_REALLOC and DARRAY_FREE.
+ *
+ * @param _arr_p: pointer to the array which shall be initialized.
+ * @param _cap:   initial capacity.
+ * @param _allocator: pointer to a struct darray_allocator.
+ *
+ * @return pointer to the header of the array (NULL if failed)
+ */
+#define darray_init_allocator(_arr_p, _cap, _allocator) _darray_init((void **)(_arr_p), (_cap) * sizeof(**(_arr_p)), (_allocator))
+
+/*
+ * Declares storage for a darray of up to _num elements of _type, that can be
+ * placed on the stack or inside another struct.
+ *
+ * Usage example:
+ *
+ *   darray_storage(int, 8) storage;
+ *   darray(int) test;
+ *
+ *   darray_init_inline(&test, &storage);
+ *
+ *   // no heap allocation until the 9th element is inserted.
+ *   darray_push_back(&test, &i1);
+ *
+ *   // only frees memory if the darray has spilled to the heap.
+ *   darray_free(&test);
+ *
+ * _type must not require a bigger alignment than struct darray_header, so
+ * data starts right after the header like in a heap allocated darray.
+ */
+#define darray_storage(_type, _num) struct{\
+    struct darray_header header;\
+    _type data[_num];\
+    _Static_assert(_Alignof(_type) <= _Alignof(struct darray_header), "darray_storage: _type is aligned stricter than struct darray_header");\
+}
+
+/*
+ * Function to initialize the darray in storage declared with darray_storage.
+ *
+ * The darray uses the storage until its capacity is exceeded and then moves
+ * to memory allocated with DARRAY_MALLOC. It never moves back, so the storage
+ * may be reused once the darray has spilled. The storage has to outlive the
+ * darray otherwise.
+ *
+ * @param _arr_p: pointer to the array which shall be initialized.
+ * @param _storage_p: pointer to the storage.
+ *
+ * @return pointer to the header of the array
+ */
+#define darray_init_inline(_arr_p, _storage_p) _darray_init_inline((void **)(_arr_p), &(_storage_p)->header, sizeof((_storage_p)->data))
 
 /*
  * Pushes an _elem to the back of the darray. 
@@ -233,6 +365,68 @@ struct darray_header{
  */
 #define darray_pop_back(_arr_p) darray_pop(_arr_p, darray_size(_arr_p)-1)
 
+/*
+ * Removes the element at _index by moving the last element into its place.
+ *
+ * Does not keep the order of the elements but only copies one element
+ * instead of everything after _index.
+ *
+ * @param _arr_p: Pointer to the darray.
+ * @param _index: Index at which position the element should be removed.
+ *
+ * @return int: 1 if succes, 0 if failed
+ */
+#define darray_swap_remove(_arr_p, _index) _darray_swap_remove((void **)(_arr_p), sizeof(**(_arr_p)), (_index)*sizeof(**(_arr_p)))
+
+/*
+ * Removes every element for which _pred is true in a single pass.
+ *
+ * The order of the remaining elements is kept. The darray is shrunk at most
+ * once at the end.
+ *
+ * Example (removes all negative elements):
+ *
+ *   darray_remove_if(&test, elem, *elem < 0);
+ *
+ * @param _arr_p: Pointer to the darray.
+ * @param _elem_p: Name of the pointer to the current element that can be used in _pred.
+ * @param _pred: Expression that is true if the element should be removed.
+ */
+#define darray_remove_if(_arr_p, _elem_p, _pred) do{\
+    size_t _darray_size = darray_size(_arr_p), _darray_dst = 0;\
+    for(size_t _darray_src = 0; _darray_src < _darray_size; _darray_src++){\
+        typeof(**(_arr_p)) *_elem_p = &(*(_arr_p))[_darray_src];\
+        if(!(_pred)){\
+            if(_darray_dst != _darray_src)\
+                (*(_arr_p))[_darray_dst] = *(_elem_p);\
+            _darray_dst++;\
+        }\
+    }\
+    _darray_truncate((void **)(_arr_p), _darray_dst * sizeof(**(_arr_p)));\
+}while(0)
+
+/*
+ * Removes every element for which _pred is true in a single pass.
+ *
+ * Same as darray_remove_if, but holes are filled with elements from the end
+ * of the darray, so the order is not kept and fewer elements are copied.
+ *
+ * @param _arr_p: Pointer to the darray.
+ * @param _elem_p: Name of the pointer to the current element that can be used in _pred.
+ * @param _pred: Expression that is true if the element should be removed.
+ */
+#define darray_remove_if_unstable(_arr_p, _elem_p, _pred) do{\
+    size_t _darray_size = darray_size(_arr_p), _darray_i = 0;\
+    while(_darray_i < _darray_size){\
+        typeof(**(_arr_p)) *_elem_p = &(*(_arr_p))[_darray_i];\
+        if(_pred)\
+            *(_elem_p) = (*(_arr_p))[--_darray_size];\
+        else\
+            _darray_i++;\
+    }\
+    _darray_truncate((void **)(_arr_p), _darray_size * sizeof(**(_arr_p)));\
+}while(0)
+
 /*
  * Frees the content of array and sets its pointer to 0.
  *
@@ -240,6 +434,38 @@ struct darray_header{
  */
 #define darray_free(_arr_p) _darray_free((void **)(_arr_p))
 
+/*
+ * Increases the capacity of the darray to at least _cap elements.
+ *
+ * Does nothing if the capacity is already big enough.
+ *
+ * @param _arr_p: Pointer to the darray.
+ * @param _cap: Number of elements the darray should be able to hold.
+ *
+ * @return int: 1 if succes, 0 if failed
+ */
+#define darray_reserve(_arr_p, _cap) _darray_reserve((void **)(_arr_p), (_cap)*sizeof(**(_arr_p)))
+
+/*
+ * Reduces the capacity of the darray to its size.
+ *
+ * @param _arr_p: Pointer to the darray.
+ *
+ * @return int: 1 if succes, 0 if failed (the darray is left unchanged)
+ */
+#define darray_shrink_to_fit(_arr_p) _darray_shrink_to_fit((void **)(_arr_p))
+
+/*
+ * Enables or disables automatic shrinking when elements are removed.
+ *
+ * Arrays that are refilled and drained constantly should disable it, since
+ * shrinking only leads to reallocating the same memory again.
+ *
+ * @param _arr_p: Pointer to the darray.
+ * @param _noshrink: 1 to disable shrinking, 0 to enable it.
+ */
+#define darray_noshrink(_arr_p, _noshrink) _darray_set_flag((void **)(_arr_p), DARRAY_NOSHRINK, (_noshrink))
+
 /*
  * Returns the size of the darray.
  *
@@ -249,22 +475,188 @@ struct darray_header{
  */
 #define darray_size(_arr_p) (DARRAY_HEADER(*(_arr_p))->size /sizeof(**(_arr_p)))
 
+/*
+ * Returns the smallest power of two bigger than x, 0 if it does not fit into a size_t.
+ */
 static inline size_t _darray_ciellog2(size_t x){
-    size_t i; 
-    for(i = 1; i <= x; i*=DARRAY_GROWTH_FACTOR);
-    return i;
+    if(x == 0)
+        return 1;
+    if(x > SIZE_MAX / 2)
+        return 0;
+    return (size_t)1 << (sizeof(unsigned long long) * 8 - __builtin_clzll((unsigned long long)x));
+}
+
+/*
+ * Returns the capacity for an array of size bytes according to DARRAY_GROWTH_POLICY.
+ *
+ * @param cap: current capacity (0 to get the capacity a fresh array of size bytes would have)
+ * @param size: number of bytes that have to fit
+ * @return the capacity, 0 if it does not fit into a size_t together with the header
+ */
+static inline size_t _darray_capacity(size_t cap, size_t size){
+#if DARRAY_GROWTH_POLICY == DARRAY_GROWTH_1_5X
+    if(cap > SIZE_MAX - cap / 2)
+        cap = 0;
+    else
+        cap += cap / 2;
+    if(cap <= size){
+        if(size > SIZE_MAX - size / 2 - 1)
+            return 0;
+        cap = size + size / 2 + 1;
+    }
+#else
+    cap = _darray_ciellog2(size);
+#endif
+    if(cap > SIZE_MAX - sizeof(struct darray_header))
+        return 0;
+    return cap;
+}
+
+/*
+ * Internal function to set header->cap after header has been (re)allocated with cap bytes.
+ */
+static inline struct darray_header *_darray_set_cap(struct darray_header *header, size_t cap){
+#if DARRAY_USABLE_SIZE
+    if(header->allocator == NULL){
+        header->cap = malloc_usable_size(header) - sizeof(struct darray_header);
+        return header;
+    }
+#endif
+    header->cap = cap;
+    return header;
+}
+
+/*
+ * Internal function to allocate a new block with room for cap bytes.
+ * Sets cap and allocator of the new header.
+ *
+ * @return the new header, NULL if failed
+ */
+static inline struct darray_header *_darray_alloc(const struct darray_allocator *allocator, size_t cap){
+    struct darray_header *header;
+    if(allocator == NULL)
+        header = (struct darray_header *)DARRAY_MALLOC(sizeof(struct darray_header) + cap);
+    else if(allocator->alloc_fn != NULL)
+        header = (struct darray_header *)allocator->alloc_fn(allocator->ctx, sizeof(struct darray_header) + cap);
+    else
+        header = (struct darray_header *)allocator->realloc_fn(allocator->ctx, NULL, 0, sizeof(struct darray_header) + cap);
+    if(header == NULL)
+        return NULL;
+    header->allocator = allocator;
+    return _darray_set_cap(header, cap);
+}
+
+/*
+ * Internal function to resize header to room for cap bytes.
+ * Sets header->cap to the capacity of the new block.
+ *
+ * A darray in inline storage is moved to a newly allocated block when it
+ * grows and keeps its storage (and capacity) when it shrinks.
+ *
+ * @return the new header, NULL if failed (the old block is still valid)
+ */
+static inline struct darray_header *_darray_realloc(struct darray_header *header, size_t cap){
+    const struct darray_allocator *allocator = header->allocator;
+    if(header->flags & DARRAY_INLINE){
+        struct darray_header *new_header;
+        if(cap <= header->cap)
+            return header;
+        if((new_header = _darray_alloc(allocator, cap)) == NULL)
+            return NULL;
+        memcpy(&new_header[1], &header[1], header->size);
+        new_header->size = header->size;
+        new_header->flags = header->flags & ~(size_t)DARRAY_INLINE;
+        return new_header;
+    }
+    if(allocator == NULL)
+        header = (struct darray_header *)DARRAY_REALLOC(header, sizeof(struct darray_header) + cap);
+    else
+        header = (struct darray_header *)allocator->realloc_fn(allocator->ctx, header, sizeof(struct darray_header) + header->cap, sizeof(struct darray_header) + cap);
+    if(header == NULL)
+        return NULL;
+    return _darray_set_cap(header, cap);
+}
+
+/*
+ * Internal function to free the block of header.
+ */
+static inline void _darray_dealloc(struct darray_header *header){
+    const struct darray_allocator *allocator = header->allocator;
+    if(header->flags & DARRAY_INLINE)
+        return;
+    if(allocator == NULL)
+        DARRAY_FREE(header);
+    else
+        allocator->free_fn(allocator->ctx, header, sizeof(struct darray_header) + header->cap);
 }
 
-static inline struct darray_header *_darray_init(void **dst, size_t cap){
+static inline struct darray_header *_darray_init(void **dst, size_t cap, const struct darray_allocator *allocator){
     struct darray_header *header = NULL;
-    if((header = (struct darray_header *)DARRAY_MALLOC(sizeof(struct darray_header) + cap)) == NULL)
+    if((header = _darray_alloc(allocator, cap)) == NULL)
         return NULL;
     header->size = 0;
+    header->flags = 0;
+    *dst = (void *)&header[1];
+    return header;
+}
+
+static inline struct darray_header *_darray_init_inline(void **dst, struct darray_header *header, size_t cap){
+    header->size = 0;
     header->cap = cap;
+    header->flags = DARRAY_INLINE;
+    header->allocator = NULL;
     *dst = (void *)&header[1];
     return header;
 }
 
+static inline int _darray_reserve(void **dst, size_t cap){
+    struct darray_header *header = DARRAY_HEADER(*dst);
+    if(cap > header->cap){
+        if((header = _darray_realloc(header, cap)) == NULL)
+            return 0;
+        *dst = (void *)&header[1];
+    }
+    return 1;
+}
+
+static inline int _darray_shrink_to_fit(void **dst){
+    struct darray_header *header = DARRAY_HEADER(*dst);
+    if(header->size < header->cap){
+        if((header = _darray_realloc(header, header->size)) == NULL)
+            return 0;
+        *dst = (void *)&header[1];
+    }
+    return 1;
+}
+
+static inline void _darray_set_flag(void **dst, size_t flag, int set){
+    struct darray_header *header = DARRAY_HEADER(*dst);
+    if(set)
+        header->flags |= flag;
+    else
+        header->flags &= ~flag;
+}
+
+/*
+ * Internal function shrinking the darray after elements have been removed.
+ *
+ * Does nothing if DARRAY_NOSHRINK is set or the capacity is still less than
+ * DARRAY_SHRINK_FACTOR times the capacity needed for the current size.
+ * Failing to shrink is not an error since the old block is still valid.
+ */
+static inline void _darray_shrink(void **dst){
+    struct darray_header *header = DARRAY_HEADER(*dst);
+    if(header->flags & DARRAY_NOSHRINK)
+        return;
+    size_t cap = _darray_capacity(0, header->size);
+    // Devided the header-size by DARRAY_SHRINK_FACTOR for histeresis.
+    if(cap != 0 && cap < header->cap / DARRAY_SHRINK_FACTOR){
+        if((header = _darray_realloc(header, cap)) == NULL)
+            return;
+        *dst = (void *)&header[1];
+    }
+}
+
 /*
  * _darray_insert function:
  *
@@ -303,13 +695,43 @@ static inline struct darray_header *_darray_init(void **dst, size_t cap){
  * | before index | src | after index | free space |
  * +--------------+-----+-------------+------------+
  *
- * If we could know weather realloc copies the block or just expands it we
- * could then copy "after index" directly to the correct position.
+ * Since we can't know weather realloc copies the block or just expands it,
+ * inserting in the middle of the array (when there is an "after index" block)
+ * allocates a new block instead and copies every part directly to its final
+ * position:
+ *
+ * +--------------+-------------+
+ * | before index | after index |
+ * +--------------+-------------+
+ *  |               |
+ *  v               +------+
+ * +--------------+-----+-------------+------------+
+ * | before index | src | after index | free space |
+ * +--------------+-----+-------------+------------+
+ *                   ^
+ *                   |
+ *                  src
+ *
+ * Appending (index >= size) still uses realloc, since then there is nothing
+ * to copy twice and realloc might be able to expand the block in place.
+ * The same holds for darrays whose allocator can only resize (no alloc_fn)
+ * or resizes the old and the new block without copying (DARRAY_ALLOC_REMAP).
+ */
+
+/*
+ * Internal function returning 1 if allocator resizes a block of cap bytes to
+ * new_cap bytes without copying it.
  */
+static inline int _darray_remaps(const struct darray_allocator *allocator, size_t cap, size_t new_cap){
+    size_t min = allocator->remap_min;
+    return (allocator->flags & DARRAY_ALLOC_REMAP) &&
+        cap + sizeof(struct darray_header) >= min && new_cap + sizeof(struct darray_header) >= min;
+}
 
 /*
  * Function to insert from src of size src_size in dst at index.
- *
+ * src may point into the darray itself, the inserted bytes are the ones src
+ * pointed to before the insert.
  */
 static inline int _darray_insert(void **dst, void *src, size_t src_size, size_t index){
     struct darray_header *header = DARRAY_HEADER(*dst);
@@ -317,14 +739,37 @@ static inline int _darray_insert(void **dst, void *src, size_t src_size, size_t
     size_t target_size = header->size;
     if(index > header->size)
         target_size = index;
+    if(src_size > SIZE_MAX - target_size)
+        return 0;
 
-    size_t cap = _darray_ciellog2(target_size+src_size);
-    // since header is a temporary pointer it should be ok to overwrite it with realloc.
-    if(cap > header->cap){
-        if((header = (struct darray_header *)DARRAY_REALLOC(header, sizeof(struct darray_header)+cap)) == NULL)
+    if(target_size+src_size > header->cap){
+        size_t cap = _darray_capacity(header->cap, target_size+src_size);
+        if(cap == 0)
+            return 0;
+        if(index < header->size && (header->allocator == NULL ||
+                    (header->allocator->alloc_fn != NULL && !_darray_remaps(header->allocator, header->cap, cap)))){
+            struct darray_header *new_header;
+            if((new_header = _darray_alloc(header->allocator, cap)) == NULL)
+                return 0;
+            // src may point into the old block so it is only freed after copying.
+            memcpy(&new_header[1], *dst, index);
+            memcpy(((uint8_t *)&new_header[1])+index, src, src_size);
+            memcpy(((uint8_t *)&new_header[1])+index+src_size, ((uint8_t *)*dst)+index, header->size-index);
+            new_header->size = header->size+src_size;
+            new_header->flags = header->flags & ~(size_t)DARRAY_INLINE;
+            _darray_dealloc(header);
+            *dst = (void *)&new_header[1];
+            return 1;
+        }
+        // realloc may free the old block, so src is rebased if it points into it.
+        int inside = (uint8_t *)src >= (uint8_t *)*dst && (uint8_t *)src < (uint8_t *)*dst + header->size;
+        size_t offset = (uint8_t *)src - (uint8_t *)*dst;
+        // since header is a temporary pointer it should be ok to overwrite it with realloc.
+        if((header = _darray_realloc(header, cap)) == NULL)
             return 0;
-        header->cap = cap;
         *dst = (void *)&header[1];
+        if(inside)
+            src = (uint8_t *)*dst + offset;
     }
     // either cap was les or equal to header->cap therefore header is still the same and not NULL
     // or we sucessfully allocated new memory.
@@ -333,7 +778,17 @@ static inline int _darray_insert(void **dst, void *src, size_t src_size, size_t
     // set memory to zero if index > header->size
     memset(((uint8_t *)*dst)+header->size, 0, target_size-header->size);
     memmove(((uint8_t *)*dst)+src_size+index, ((uint8_t *)*dst)+index, target_size-index);
-    memmove(((uint8_t *)*dst)+index, src, src_size);
+    if((uint8_t *)src >= (uint8_t *)*dst && (uint8_t *)src < ((uint8_t *)*dst)+target_size &&
+            (uint8_t *)src+src_size > ((uint8_t *)*dst)+index){
+        // src overlaps the moved tail, the part of src from index on moved by src_size.
+        size_t head = ((uint8_t *)*dst)+index-(uint8_t *)src;
+        if((uint8_t *)src >= ((uint8_t *)*dst)+index)
+            head = 0;
+        memmove(((uint8_t *)*dst)+index, src, head);
+        memmove(((uint8_t *)*dst)+index+head, (uint8_t *)src+head+src_size, src_size-head);
+    }
+    else
+        memmove(((uint8_t *)*dst)+index, src, src_size);
     header->size = target_size+src_size;
     return 1;
 }
@@ -349,17 +804,29 @@ static inline int _darray_remove(void **dst, size_t size, size_t index){
         return 0;
     memmove(((uint8_t *)*dst)+index, ((uint8_t *)*dst)+index+size, header->size-(index + size));
     header->size -= size;
-    size_t cap = _darray_ciellog2(header->size);
-    // Devided the header-size by DARRAY_SHRINK_FACTOR for histeresis.
-    if(cap < header->cap / DARRAY_SHRINK_FACTOR){
-        if((header = (struct darray_header *)DARRAY_REALLOC(header, sizeof(struct darray_header)+cap)) == NULL)
-            return 1;
-        header->cap = cap;
-        *dst = (void *)&header[1];
-    }
+    _darray_shrink(dst);
     return 1;
 }
 
+static inline int _darray_swap_remove(void **dst, size_t size, size_t index){
+    struct darray_header *header = DARRAY_HEADER(*dst);
+    if(index+size > header->size)
+        return 0;
+    header->size -= size;
+    if(index != header->size)
+        memcpy(((uint8_t *)*dst)+index, ((uint8_t *)*dst)+header->size, size);
+    _darray_shrink(dst);
+    return 1;
+}
+
+/*
+ * Internal function setting the size of the darray to size bytes (size <= header->size).
+ */
+static inline void _darray_truncate(void **dst, size_t size){
+    DARRAY_HEADER(*dst)->size = size;
+    _darray_shrink(dst);
+}
+
 static inline void *_darray_pop_back(void **dst, size_t size){
     struct darray_header *header = DARRAY_HEADER(*dst);
     void *ret = ((uint8_t *)*dst)+header->size-size;
@@ -371,8 +838,7 @@ static inline void *_darray_pop_back(void **dst, size_t size){
 
 
 static inline void _darray_free(void **dst){
-    struct darray_header *header = DARRAY_HEADER(*dst);
-    DARRAY_FREE(header);
+    _darray_dealloc(DARRAY_HEADER(*dst));
     *dst = NULL;
 }
 
@@ -0,0 +1,188 @@
+/*
+   Copyright (c) 2021 Christian Döring
+   Permission is hereby granted, free of charge, to any person obtaining a copy
+   of this software and associated documentation files (the "Software"), to deal
+   in the Software without restriction, including without limitation the rights
+   to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+   copies of the Software, and to permit persons to whom the Software is
+   furnished to do so, subject to the following conditions:
+   The above copyright notice and this permission notice shall be included in all
+   copies or substantial portions of the Software.
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+   IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+   FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+   AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+   LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+   OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+   SOFTWARE.
+   */
+
+#ifndef DARRAY_FILE_H
+#define DARRAY_FILE_H
+
+/*
+ * mremap needs _GNU_SOURCE. It only takes effect if it is defined before the
+ * first system header, so it has to be defined by the caller, best on the
+ * command line (-D_GNU_SOURCE).
+ */
+#ifndef _GNU_SOURCE
+#error "darray_file.h needs _GNU_SOURCE defined before any header is included"
+#endif
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "darray.h"
+
+/*
+ * File backed darray (Linux only).
+ *
+ * The file holds the darray_header followed by the data, exactly the block
+ * darray keeps in memory:
+ *
+ * +--------+-------------+-----------------+
+ * | header | size bytes  | unused capacity |
+ * +--------+-------------+-----------------+
+ * |<-            file size              ->|
+ *
+ * The file is mapped shared, so the darray is modified in place. Growing
+ * extends the file with ftruncate and the mapping with mremap, nothing is
+ * copied and the new capacity is a hole in the file until it is written.
+ * Opening an existing file maps it again and the kernel pages the data in
+ * on access, there is no deserialization.
+ *
+ * The header is stored as is, so a file can only be opened on a machine with
+ * the same size_t and element layout. The allocator pointer in the header is
+ * reset on every open.
+ *
+ * Usage example:
+ *
+ *   struct darray_file file;
+ *   darray(int) test;
+ *
+ *   if(darray_file_open(&test, &file, "test.bin", 1024) == NULL)
+ *       return -1;
+ *
+ *   int i = 1;
+ *   darray_push_back(&test, &i);
+ *
+ *   darray_file_close(&test);
+ */
+struct darray_file{
+    struct darray_allocator allocator;
+    int fd;
+};
+
+/*
+ * Opens or creates the file at _path as the darray.
+ *
+ * @param _arr_p: pointer to the darray.
+ * @param _file: pointer to a struct darray_file, has to outlive the darray.
+ * @param _path: path of the file.
+ * @param _cap: initial capacity if the file is created.
+ *
+ * @return pointer to the header of the array (NULL if failed or if the file is no darray of this type)
+ */
+#define darray_file_open(_arr_p, _file, _path, _cap) _darray_file_open((void **)(_arr_p), (_file), (_path), (_cap) * sizeof(**(_arr_p)), sizeof(**(_arr_p)))
+
+/*
+ * Writes the header and the elements of the darray back to the file.
+ *
+ * @param _arr_p: pointer to the darray.
+ *
+ * @return int: 1 if succes, 0 if failed
+ */
+#define darray_file_sync(_arr_p) _darray_file_sync((void **)(_arr_p))
+
+/*
+ * Unmaps the darray and closes its file. The file keeps the elements.
+ *
+ * @param _arr_p: pointer to the darray.
+ */
+#define darray_file_close(_arr_p) _darray_file_close((void **)(_arr_p))
+
+/*
+ * Internal function mapping or resizing the mapping of the file.
+ * Used as realloc of the allocator.
+ */
+static inline void *_darray_file_realloc(void *ctx, void *ptr, size_t old_size, size_t size){
+    struct darray_file *file = (struct darray_file *)ctx;
+    void *data;
+    if(ptr == NULL){
+        if(ftruncate(file->fd, (off_t)size) != 0)
+            return NULL;
+        data = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, file->fd, 0);
+        return data == MAP_FAILED ? NULL : data;
+    }
+    // Grow the file before the mapping and shrink it after, so no page is mapped past the end of the file.
+    if(size > old_size && ftruncate(file->fd, (off_t)size) != 0)
+        return NULL;
+    if((data = mremap(ptr, old_size, size, MREMAP_MAYMOVE)) == MAP_FAILED)
+        return NULL;
+    // A file that could not be shrunk only keeps more capacity.
+    if(size < old_size)
+        (void)!ftruncate(file->fd, (off_t)size);
+    return data;
+}
+
+/*
+ * Internal function unmapping the file. Used as free of the allocator.
+ */
+static inline void _darray_file_free(void *ctx, void *ptr, size_t size){
+    (void)ctx;
+    munmap(ptr, size);
+}
+
+static inline struct darray_header *_darray_file_open(void **dst, struct darray_file *file, const char *path, size_t cap, size_t elem_size){
+    struct darray_header *header;
+    struct stat st;
+
+    file->allocator.alloc_fn = NULL;
+    file->allocator.realloc_fn = _darray_file_realloc;
+    file->allocator.free_fn = _darray_file_free;
+    file->allocator.ctx = file;
+    file->allocator.flags = DARRAY_ALLOC_REMAP;
+    file->allocator.remap_min = 0;
+    if((file->fd = open(path, O_RDWR | O_CREAT | O_CLOEXEC, 0644)) < 0)
+        return NULL;
+    if(fstat(file->fd, &st) != 0)
+        goto err;
+
+    if(st.st_size == 0){
+        if((header = _darray_init(dst, cap, &file->allocator)) == NULL)
+            goto err;
+        return header;
+    }
+
+    if((size_t)st.st_size < sizeof(struct darray_header))
+        goto err;
+    header = (struct darray_header *)mmap(NULL, (size_t)st.st_size, PROT_READ | PROT_WRITE, MAP_SHARED, file->fd, 0);
+    if(header == MAP_FAILED)
+        goto err;
+    cap = (size_t)st.st_size - sizeof(struct darray_header);
+    if(header->size > cap || header->size % elem_size != 0 || (header->flags & DARRAY_INLINE)){
+        munmap(header, (size_t)st.st_size);
+        goto err;
+    }
+    header->cap = cap;
+    header->allocator = &file->allocator;
+    *dst = (void *)&header[1];
+    return header;
+err:
+    close(file->fd);
+    return NULL;
+}
+
+static inline int _darray_file_sync(void **dst){
+    struct darray_header *header = DARRAY_HEADER(*dst);
+    return msync(header, sizeof(struct darray_header) + header->size, MS_SYNC) == 0;
+}
+
+static inline void _darray_file_close(void **dst){
+    struct darray_file *file = (struct darray_file *)DARRAY_HEADER(*dst)->allocator->ctx;
+    _darray_free(dst);
+    close(file->fd);
+}
+
+#endif //DARRAY_FILE_H
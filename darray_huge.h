@@ -0,0 +1,225 @@
+/*
+   Copyright (c) 2021 Christian Döring
+   Permission is hereby granted, free of charge, to any person obtaining a copy
+   of this software and associated documentation files (the "Software"), to deal
+   in the Software without restriction, including without limitation the rights
+   to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+   copies of the Software, and to permit persons to whom the Software is
+   furnished to do so, subject to the following conditions:
+   The above copyright notice and this permission notice shall be included in all
+   copies or substantial portions of the Software.
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+   IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+   FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+   AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+   LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+   OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+   SOFTWARE.
+   */
+
+#ifndef DARRAY_HUGE_H
+#define DARRAY_HUGE_H
+
+/*
+ * mremap and syscall need _GNU_SOURCE. It only takes effect if it is defined
+ * before the first system header, so it has to be defined by the caller,
+ * best on the command line (-D_GNU_SOURCE).
+ */
+#ifndef _GNU_SOURCE
+#error "darray_huge.h needs _GNU_SOURCE defined before any header is included"
+#endif
+
+#include <stdint.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/mempolicy.h>
+#include "darray.h"
+
+/*
+ * Allocator for large darrays (Linux only).
+ *
+ * Blocks smaller than threshold come from DARRAY_MALLOC. Bigger blocks are
+ * anonymous mappings aligned to DARRAY_HUGE_PAGE and advised with
+ * MADV_HUGEPAGE, so transparent huge pages back them and random access
+ * needs far fewer TLB entries. Mapped blocks grow and shrink with mremap,
+ * which moves page table entries instead of copying the elements. A block
+ * that cannot grow in place is moved into a new aligned area, so it stays
+ * aligned to DARRAY_HUGE_PAGE. Inserting into the middle of a mapped darray
+ * grows it the same way (DARRAY_ALLOC_REMAP) instead of copying it.
+ *
+ * The pages of mapped blocks can be placed on NUMA nodes with mbind:
+ *
+ * DARRAY_HUGE_LOCAL:      default policy of the thread (first touch).
+ * DARRAY_HUGE_BIND:       only on the nodes in nodemask.
+ * DARRAY_HUGE_INTERLEAVE: round robin over the nodes in nodemask.
+ *
+ * Usage example (interleave over node 0 and 1):
+ *
+ *   struct darray_huge huge;
+ *   darray(int) test;
+ *
+ *   darray_huge_init(&huge, 4 << 20, DARRAY_HUGE_INTERLEAVE, 0x3);
+ *   darray_init_allocator(&test, 0, &huge.allocator);
+ *   ...
+ *   darray_free(&test);
+ */
+#define DARRAY_HUGE_LOCAL 0
+#define DARRAY_HUGE_BIND 1
+#define DARRAY_HUGE_INTERLEAVE 2
+
+/*
+ * Size of a huge page. Mapped blocks are aligned to and rounded up to it.
+ */
+#ifndef DARRAY_HUGE_PAGE
+#define DARRAY_HUGE_PAGE ((size_t)2 << 20)
+#endif
+
+/*
+ * @param threshold: blocks of at least threshold bytes are mapped.
+ * @param policy: DARRAY_HUGE_LOCAL, DARRAY_HUGE_BIND or DARRAY_HUGE_INTERLEAVE.
+ * @param nodemask: bit n selects NUMA node n.
+ */
+struct darray_huge{
+    struct darray_allocator allocator;
+    size_t threshold;
+    int policy;
+    unsigned long nodemask;
+};
+
+/*
+ * Internal function returning the length of the mapping for a block of size bytes.
+ */
+static inline size_t _darray_huge_len(size_t size){
+    return (size + DARRAY_HUGE_PAGE - 1) & ~(DARRAY_HUGE_PAGE - 1);
+}
+
+/*
+ * Internal function advising huge pages and applying the NUMA policy to a mapping.
+ * Both are hints, failing (no THP, no NUMA) is not an error.
+ */
+static inline void _darray_huge_advise(struct darray_huge *self, void *ptr, size_t len){
+    madvise(ptr, len, MADV_HUGEPAGE);
+    if(self->policy != DARRAY_HUGE_LOCAL){
+        int mode = self->policy == DARRAY_HUGE_BIND ? MPOL_BIND : MPOL_INTERLEAVE;
+        syscall(SYS_mbind, ptr, len, mode, &self->nodemask, sizeof(self->nodemask) * 8 + 1, 0);
+    }
+}
+
+/*
+ * Internal function mapping len bytes aligned to DARRAY_HUGE_PAGE with prot.
+ *
+ * @return pointer to the mapping, NULL if failed
+ */
+static inline void *_darray_huge_reserve(size_t len, int prot){
+    uint8_t *data = (uint8_t *)mmap(NULL, len + DARRAY_HUGE_PAGE, prot, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if(data == MAP_FAILED)
+        return NULL;
+    size_t head = (DARRAY_HUGE_PAGE - ((uintptr_t)data & (DARRAY_HUGE_PAGE - 1))) & (DARRAY_HUGE_PAGE - 1);
+    if(head != 0)
+        munmap(data, head);
+    munmap(data + head + len, DARRAY_HUGE_PAGE - head);
+    return data + head;
+}
+
+/*
+ * Internal function mapping len bytes aligned to DARRAY_HUGE_PAGE.
+ *
+ * @return pointer to the mapping, NULL if failed
+ */
+static inline void *_darray_huge_map(struct darray_huge *self, size_t len){
+    void *data;
+    if((data = _darray_huge_reserve(len, PROT_READ | PROT_WRITE)) == NULL)
+        return NULL;
+    _darray_huge_advise(self, data, len);
+    return data;
+}
+
+/*
+ * Internal function resizing the mapping at ptr from old_len to len bytes.
+ *
+ * The mapping is grown in place if the pages behind it are free. Otherwise
+ * mremap with MREMAP_MAYMOVE alone could move it to any page boundary, so an
+ * aligned area is reserved first and the mapping is moved onto it with
+ * MREMAP_FIXED.
+ *
+ * @return pointer to the mapping, NULL if failed (the old mapping is still valid)
+ */
+static inline void *_darray_huge_remap(struct darray_huge *self, void *ptr, size_t old_len, size_t len){
+    void *data, *area;
+    if((data = mremap(ptr, old_len, len, 0)) == MAP_FAILED){
+        if((area = _darray_huge_reserve(len, PROT_NONE)) == NULL)
+            return NULL;
+        if((data = mremap(ptr, old_len, len, MREMAP_MAYMOVE | MREMAP_FIXED, area)) == MAP_FAILED){
+            munmap(area, len);
+            return NULL;
+        }
+    }
+    if(len > old_len)
+        _darray_huge_advise(self, data, len);
+    return data;
+}
+
+static inline void *_darray_huge_malloc(void *ctx, size_t size){
+    struct darray_huge *self = (struct darray_huge *)ctx;
+    if(size < self->threshold)
+        return DARRAY_MALLOC(size);
+    return _darray_huge_map(self, _darray_huge_len(size));
+}
+
+static inline void *_darray_huge_realloc(void *ctx, void *ptr, size_t old_size, size_t size){
+    struct darray_huge *self = (struct darray_huge *)ctx;
+    void *data;
+    if(old_size < self->threshold && size < self->threshold)
+        return DARRAY_REALLOC(ptr, size);
+    if(old_size >= self->threshold && size >= self->threshold){
+        size_t old_len = _darray_huge_len(old_size), len = _darray_huge_len(size);
+        if(len == old_len)
+            return ptr;
+        return _darray_huge_remap(self, ptr, old_len, len);
+    }
+    // Crossing the threshold, the block moves between malloc and a mapping.
+    if((data = _darray_huge_malloc(ctx, size)) == NULL)
+        return NULL;
+    memcpy(data, ptr, old_size < size ? old_size : size);
+    if(old_size < self->threshold)
+        DARRAY_FREE(ptr);
+    else
+        munmap(ptr, _darray_huge_len(old_size));
+    return data;
+}
+
+static inline void _darray_huge_free(void *ctx, void *ptr, size_t size){
+    struct darray_huge *self = (struct darray_huge *)ctx;
+    if(size < self->threshold)
+        DARRAY_FREE(ptr);
+    else
+        munmap(ptr, _darray_huge_len(size));
+}
+
+/*
+ * Initializes the allocator. It can be shared by any number of darrays and
+ * has to outlive all of them.
+ *
+ * @param self: pointer to the allocator.
+ * @param threshold: blocks of at least threshold bytes are mapped.
+ * @param policy: DARRAY_HUGE_LOCAL, DARRAY_HUGE_BIND or DARRAY_HUGE_INTERLEAVE.
+ * @param nodemask: bit n selects NUMA node n (ignored for DARRAY_HUGE_LOCAL).
+ *
+ * @return pointer to the struct darray_allocator to pass to darray_init_allocator
+ */
+static inline const struct darray_allocator *darray_huge_init(struct darray_huge *self, size_t threshold, int policy, unsigned long nodemask){
+    self->allocator.alloc_fn = _darray_huge_malloc;
+    self->allocator.realloc_fn = _darray_huge_realloc;
+    self->allocator.free_fn = _darray_huge_free;
+    self->allocator.ctx = self;
+    // Only the mapped blocks are remapped, smaller ones are copied by realloc.
+    self->allocator.flags = DARRAY_ALLOC_REMAP;
+    self->allocator.remap_min = threshold;
+    self->threshold = threshold;
+    self->policy = policy;
+    self->nodemask = nodemask;
+    return &self->allocator;
+}
+
+#endif //DARRAY_HUGE_H
@@ -0,0 +1,611 @@
+/*
+Copyright (c) 2021 Christian Döring
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#ifndef DARRAY_SIMD_H
+#define DARRAY_SIMD_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "darray.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#define DARRAY_SIMD_X86 1
+#include <immintrin.h>
+#else
+#define DARRAY_SIMD_X86 0
+#endif
+
+/*
+ * Search, fill and compare kernels over darrays of int32_t, uint32_t,
+ * int64_t and uint64_t.
+ *
+ * Every kernel exists as scalar, SSE2, AVX2 and AVX-512 version. The best
+ * version the cpu supports is selected at the first call and used from then
+ * on, so the header can be compiled without any -m flags. On other
+ * architectures only the scalar versions are available.
+ *
+ * The darray_* macros pick the kernels by the element type of the darray,
+ * other element types do not compile.
+ *
+ * Usage example:
+ *
+ *   darray(int32_t) test;
+ *   darray_init(&test, 0);
+ *   ...
+ *   size_t i = darray_find(&test, 42);
+ *   if(i != darray_size(&test))
+ *       printf("found at %zu\n", i);
+ */
+
+/*
+ * Table of the kernels for one element type and instruction set.
+ *
+ * @param find: index of the first element equal to val, n if there is none
+ * @param count: number of elements equal to val
+ * @param min: smallest element, the biggest value of the type if n == 0
+ * @param max: biggest element, the smallest value of the type if n == 0
+ * @param fill: sets all n elements to val
+ * @param equal: 1 if the n elements of a and b are equal, 0 else
+ */
+#define _DARRAY_SIMD_STRUCT_DEFINE(_sfx, _type)\
+struct darray_simd_##_sfx{\
+    size_t (*find)(const _type *data, size_t n, _type val);\
+    size_t (*count)(const _type *data, size_t n, _type val);\
+    _type (*min)(const _type *data, size_t n);\
+    _type (*max)(const _type *data, size_t n);\
+    void (*fill)(_type *data, size_t n, _type val);\
+    int (*equal)(const _type *a, const _type *b, size_t n);\
+};
+
+_DARRAY_SIMD_STRUCT_DEFINE(i32, int32_t)
+_DARRAY_SIMD_STRUCT_DEFINE(u32, uint32_t)
+_DARRAY_SIMD_STRUCT_DEFINE(i64, int64_t)
+_DARRAY_SIMD_STRUCT_DEFINE(u64, uint64_t)
+
+/*
+ * Internal macro selecting the kernels for the element type of the darray.
+ */
+#define _DARRAY_SIMD(_arr_p) _Generic(**(_arr_p),\
+        int32_t: _darray_simd_i32, uint32_t: _darray_simd_u32,\
+        int64_t: _darray_simd_i64, uint64_t: _darray_simd_u64)()
+
+/*
+ * Returns the index of the first element equal to _val, darray_size if there is none.
+ */
+#define darray_find(_arr_p, _val) (_DARRAY_SIMD(_arr_p)->find(*(_arr_p), darray_size(_arr_p), (_val)))
+
+/*
+ * Returns the number of elements equal to _val.
+ */
+#define darray_count(_arr_p, _val) (_DARRAY_SIMD(_arr_p)->count(*(_arr_p), darray_size(_arr_p), (_val)))
+
+/*
+ * Returns the smallest element (the biggest value of the type if the darray is empty).
+ */
+#define darray_min(_arr_p) (_DARRAY_SIMD(_arr_p)->min(*(_arr_p), darray_size(_arr_p)))
+
+/*
+ * Returns the biggest element (the smallest value of the type if the darray is empty).
+ */
+#define darray_max(_arr_p) (_DARRAY_SIMD(_arr_p)->max(*(_arr_p), darray_size(_arr_p)))
+
+/*
+ * Sets every element of the darray to _val.
+ */
+#define darray_fill(_arr_p, _val) (_DARRAY_SIMD(_arr_p)->fill(*(_arr_p), darray_size(_arr_p), (_val)))
+
+/*
+ * Returns 1 if both darrays have the same size and elements, 0 else.
+ */
+#define darray_equal(_a_p, _b_p) (darray_size(_a_p) == darray_size(_b_p) &&\
+        _DARRAY_SIMD(_a_p)->equal(*(_a_p), *(_b_p), darray_size(_a_p)))
+
+/*
+ * Returns the index of the first element that is not less than _val in a
+ * sorted darray, darray_size if there is none.
+ */
+#define darray_lower_bound(_arr_p, _val) (_Generic(**(_arr_p),\
+        int32_t: _darray_lower_bound_i32, uint32_t: _darray_lower_bound_u32,\
+        int64_t: _darray_lower_bound_i64, uint64_t: _darray_lower_bound_u64)(*(_arr_p), darray_size(_arr_p), (_val)))
+
+/*
+ * Internal macro defining the scalar kernels and the lower bound for _type.
+ * _min_val and _max_val are the smallest and biggest value of _type.
+ *
+ * The lower bound is a branchless binary search. The comparison only selects
+ * the next base, which compiles to a conditional move, so there are no
+ * mispredicted branches. The loop is dominated by memory latency, so there is
+ * no vector version.
+ *
+ * The scalar kernels are also used for the tails of the vector kernels.
+ */
+#define _DARRAY_SIMD_SCALAR_DEFINE(_sfx, _type, _min_val, _max_val)\
+static inline size_t _darray_lower_bound_##_sfx(const _type *data, size_t n, _type val){\
+    const _type *base = data;\
+    if(n == 0)\
+        return 0;\
+    while(n > 1){\
+        size_t half = n / 2;\
+        base = (base[half] < val) ? base + half : base;\
+        n -= half;\
+    }\
+    return (size_t)(base - data) + (*base < val);\
+}\
+\
+static inline size_t _darray_find_##_sfx##_scalar(const _type *data, size_t n, _type val){\
+    size_t i;\
+    for(i = 0; i < n && data[i] != val; i++);\
+    return i;\
+}\
+\
+static inline size_t _darray_count_##_sfx##_scalar(const _type *data, size_t n, _type val){\
+    size_t count = 0;\
+    for(size_t i = 0; i < n; i++)\
+        count += data[i] == val;\
+    return count;\
+}\
+\
+static inline _type _darray_min_##_sfx##_scalar(const _type *data, size_t n){\
+    _type min = _max_val;\
+    for(size_t i = 0; i < n; i++)\
+        min = data[i] < min ? data[i] : min;\
+    return min;\
+}\
+\
+static inline _type _darray_max_##_sfx##_scalar(const _type *data, size_t n){\
+    _type max = _min_val;\
+    for(size_t i = 0; i < n; i++)\
+        max = data[i] > max ? data[i] : max;\
+    return max;\
+}\
+\
+static inline void _darray_fill_##_sfx##_scalar(_type *data, size_t n, _type val){\
+    for(size_t i = 0; i < n; i++)\
+        data[i] = val;\
+}\
+\
+static inline int _darray_equal_##_sfx##_scalar(const _type *a, const _type *b, size_t n){\
+    for(size_t i = 0; i < n; i++)\
+        if(a[i] != b[i])\
+            return 0;\
+    return 1;\
+}
+
+_DARRAY_SIMD_SCALAR_DEFINE(i32, int32_t, INT32_MIN, INT32_MAX)
+_DARRAY_SIMD_SCALAR_DEFINE(u32, uint32_t, 0, UINT32_MAX)
+_DARRAY_SIMD_SCALAR_DEFINE(i64, int64_t, INT64_MIN, INT64_MAX)
+_DARRAY_SIMD_SCALAR_DEFINE(u64, uint64_t, 0, UINT64_MAX)
+
+#if DARRAY_SIMD_X86
+
+/*
+ * Number of vectors after which the lane counters of the count kernels are
+ * added to the result, so 32 bit lanes can not overflow.
+ */
+#define DARRAY_SIMD_COUNT_BLOCK ((size_t)1 << 30)
+
+/*
+ * SSE2 only compares signed 32 bit lanes. Unsigned lanes are compared with
+ * flipped sign bits and 64 bit lanes are combined from the 32 bit halves.
+ */
+__attribute__((target("sse2")))
+static inline __m128i _darray_sse2_cmpeq_epi64(__m128i a, __m128i b){
+    __m128i eq = _mm_cmpeq_epi32(a, b);
+    return _mm_and_si128(eq, _mm_shuffle_epi32(eq, _MM_SHUFFLE(2, 3, 0, 1)));
+}
+
+__attribute__((target("sse2")))
+static inline __m128i _darray_sse2_cmpgt_epu32(__m128i a, __m128i b){
+    __m128i sign = _mm_set1_epi32(INT32_MIN);
+    return _mm_cmpgt_epi32(_mm_xor_si128(a, sign), _mm_xor_si128(b, sign));
+}
+
+__attribute__((target("sse2")))
+static inline __m128i _darray_sse2_cmpgt_epi64(__m128i a, __m128i b){
+    // The low halves are compared unsigned, the high halves signed.
+    __m128i sign = _mm_set_epi32(0, INT32_MIN, 0, INT32_MIN);
+    a = _mm_xor_si128(a, sign);
+    b = _mm_xor_si128(b, sign);
+    __m128i gt = _mm_cmpgt_epi32(a, b), eq = _mm_cmpeq_epi32(a, b);
+    __m128i gt_hi = _mm_shuffle_epi32(gt, _MM_SHUFFLE(3, 3, 1, 1));
+    __m128i gt_lo = _mm_shuffle_epi32(gt, _MM_SHUFFLE(2, 2, 0, 0));
+    __m128i eq_hi = _mm_shuffle_epi32(eq, _MM_SHUFFLE(3, 3, 1, 1));
+    return _mm_or_si128(gt_hi, _mm_and_si128(eq_hi, gt_lo));
+}
+
+__attribute__((target("sse2")))
+static inline __m128i _darray_sse2_cmpgt_epu64(__m128i a, __m128i b){
+    __m128i sign = _mm_set1_epi64x(INT64_MIN);
+    return _darray_sse2_cmpgt_epi64(_mm_xor_si128(a, sign), _mm_xor_si128(b, sign));
+}
+
+/*
+ * Internal macro defining the SSE2 kernels for _type. SSE2 has no min/max
+ * for these lanes, they are built from _cmpgt.
+ */
+#define _DARRAY_SIMD_SSE2_DEFINE(_sfx, _type, _set1, _cmpeq, _cmpgt, _sub)\
+__attribute__((target("sse2")))\
+static inline size_t _darray_find_##_sfx##_sse2(const _type *data, size_t n, _type val){\
+    const size_t lanes = 16 / sizeof(_type);\
+    __m128i v = _set1(val);\
+    size_t i = 0;\
+    for(; i + lanes <= n; i += lanes){\
+        int mask = _mm_movemask_epi8(_cmpeq(_mm_loadu_si128((const __m128i *)&data[i]), v));\
+        if(mask)\
+            return i + __builtin_ctz(mask) / sizeof(_type);\
+    }\
+    return i + _darray_find_##_sfx##_scalar(&data[i], n - i, val);\
+}\
+\
+__attribute__((target("sse2")))\
+static inline size_t _darray_count_##_sfx##_sse2(const _type *data, size_t n, _type val){\
+    const size_t lanes = 16 / sizeof(_type);\
+    __m128i v = _set1(val);\
+    size_t count = 0, i = 0;\
+    while(i + lanes <= n){\
+        __m128i acc = _mm_setzero_si128();\
+        size_t end = n - i > lanes * DARRAY_SIMD_COUNT_BLOCK ? i + lanes * DARRAY_SIMD_COUNT_BLOCK : n;\
+        for(; i + lanes <= end; i += lanes)\
+            acc = _sub(acc, _cmpeq(_mm_loadu_si128((const __m128i *)&data[i]), v));\
+        _type counters[16 / sizeof(_type)];\
+        _mm_storeu_si128((__m128i *)counters, acc);\
+        for(size_t j = 0; j < lanes; j++)\
+            count += (size_t)counters[j];\
+    }\
+    return count + _darray_count_##_sfx##_scalar(&data[i], n - i, val);\
+}\
+\
+__attribute__((target("sse2")))\
+static inline _type _darray_min_##_sfx##_sse2(const _type *data, size_t n){\
+    const size_t lanes = 16 / sizeof(_type);\
+    __m128i min = _set1(_darray_min_##_sfx##_scalar(data, 0));\
+    size_t i = 0;\
+    for(; i + lanes <= n; i += lanes){\
+        __m128i x = _mm_loadu_si128((const __m128i *)&data[i]);\
+        __m128i gt = _cmpgt(min, x);\
+        min = _mm_or_si128(_mm_and_si128(gt, x), _mm_andnot_si128(gt, min));\
+    }\
+    _type res[16 / sizeof(_type)];\
+    _mm_storeu_si128((__m128i *)res, min);\
+    _type a = _darray_min_##_sfx##_scalar(res, lanes);\
+    _type b = _darray_min_##_sfx##_scalar(&data[i], n - i);\
+    return b < a ? b : a;\
+}\
+\
+__attribute__((target("sse2")))\
+static inline _type _darray_max_##_sfx##_sse2(const _type *data, size_t n){\
+    const size_t lanes = 16 / sizeof(_type);\
+    __m128i max = _set1(_darray_max_##_sfx##_scalar(data, 0));\
+    size_t i = 0;\
+    for(; i + lanes <= n; i += lanes){\
+        __m128i x = _mm_loadu_si128((const __m128i *)&data[i]);\
+        __m128i gt = _cmpgt(x, max);\
+        max = _mm_or_si128(_mm_and_si128(gt, x), _mm_andnot_si128(gt, max));\
+    }\
+    _type res[16 / sizeof(_type)];\
+    _mm_storeu_si128((__m128i *)res, max);\
+    _type a = _darray_max_##_sfx##_scalar(res, lanes);\
+    _type b = _darray_max_##_sfx##_scalar(&data[i], n - i);\
+    return b > a ? b : a;\
+}\
+\
+__attribute__((target("sse2")))\
+static inline void _darray_fill_##_sfx##_sse2(_type *data, size_t n, _type val){\
+    const size_t lanes = 16 / sizeof(_type);\
+    __m128i v = _set1(val);\
+    size_t i = 0;\
+    for(; i + lanes <= n; i += lanes)\
+        _mm_storeu_si128((__m128i *)&data[i], v);\
+    _darray_fill_##_sfx##_scalar(&data[i], n - i, val);\
+}\
+\
+__attribute__((target("sse2")))\
+static inline int _darray_equal_##_sfx##_sse2(const _type *a, const _type *b, size_t n){\
+    const size_t lanes = 16 / sizeof(_type);\
+    size_t i = 0;\
+    for(; i + lanes <= n; i += lanes){\
+        __m128i eq = _cmpeq(_mm_loadu_si128((const __m128i *)&a[i]), _mm_loadu_si128((const __m128i *)&b[i]));\
+        if(_mm_movemask_epi8(eq) != 0xffff)\
+            return 0;\
+    }\
+    return _darray_equal_##_sfx##_scalar(&a[i], &b[i], n - i);\
+}
+
+#define _darray_sse2_set1_32(_val) _mm_set1_epi32((int32_t)(_val))
+#define _darray_sse2_set1_64(_val) _mm_set1_epi64x((int64_t)(_val))
+
+_DARRAY_SIMD_SSE2_DEFINE(i32, int32_t, _darray_sse2_set1_32, _mm_cmpeq_epi32, _mm_cmpgt_epi32, _mm_sub_epi32)
+_DARRAY_SIMD_SSE2_DEFINE(u32, uint32_t, _darray_sse2_set1_32, _mm_cmpeq_epi32, _darray_sse2_cmpgt_epu32, _mm_sub_epi32)
+_DARRAY_SIMD_SSE2_DEFINE(i64, int64_t, _darray_sse2_set1_64, _darray_sse2_cmpeq_epi64, _darray_sse2_cmpgt_epi64, _mm_sub_epi64)
+_DARRAY_SIMD_SSE2_DEFINE(u64, uint64_t, _darray_sse2_set1_64, _darray_sse2_cmpeq_epi64, _darray_sse2_cmpgt_epu64, _mm_sub_epi64)
+
+/*
+ * AVX2 has no 64 bit min/max, they are built from the signed compare.
+ */
+__attribute__((target("avx2")))
+static inline __m256i _darray_avx2_cmpgt_epu64(__m256i a, __m256i b){
+    __m256i sign = _mm256_set1_epi64x(INT64_MIN);
+    return _mm256_cmpgt_epi64(_mm256_xor_si256(a, sign), _mm256_xor_si256(b, sign));
+}
+
+__attribute__((target("avx2")))
+static inline __m256i _darray_avx2_min_epi64(__m256i a, __m256i b){
+    return _mm256_blendv_epi8(a, b, _mm256_cmpgt_epi64(a, b));
+}
+
+__attribute__((target("avx2")))
+static inline __m256i _darray_avx2_max_epi64(__m256i a, __m256i b){
+    return _mm256_blendv_epi8(a, b, _mm256_cmpgt_epi64(b, a));
+}
+
+__attribute__((target("avx2")))
+static inline __m256i _darray_avx2_min_epu64(__m256i a, __m256i b){
+    return _mm256_blendv_epi8(a, b, _darray_avx2_cmpgt_epu64(a, b));
+}
+
+__attribute__((target("avx2")))
+static inline __m256i _darray_avx2_max_epu64(__m256i a, __m256i b){
+    return _mm256_blendv_epi8(a, b, _darray_avx2_cmpgt_epu64(b, a));
+}
+
+/*
+ * Internal macro defining the AVX2 kernels for _type.
+ */
+#define _DARRAY_SIMD_AVX2_DEFINE(_sfx, _type, _set1, _cmpeq, _min, _max, _sub)\
+__attribute__((target("avx2")))\
+static inline size_t _darray_find_##_sfx##_avx2(const _type *data, size_t n, _type val){\
+    const size_t lanes = 32 / sizeof(_type);\
+    __m256i v = _set1(val);\
+    size_t i = 0;\
+    for(; i + lanes <= n; i += lanes){\
+        unsigned mask = (unsigned)_mm256_movemask_epi8(_cmpeq(_mm256_loadu_si256((const __m256i *)&data[i]), v));\
+        if(mask)\
+            return i + __builtin_ctz(mask) / sizeof(_type);\
+    }\
+    return i + _darray_find_##_sfx##_scalar(&data[i], n - i, val);\
+}\
+\
+__attribute__((target("avx2")))\
+static inline size_t _darray_count_##_sfx##_avx2(const _type *data, size_t n, _type val){\
+    const size_t lanes = 32 / sizeof(_type);\
+    __m256i v = _set1(val);\
+    size_t count = 0, i = 0;\
+    while(i + lanes <= n){\
+        __m256i acc = _mm256_setzero_si256();\
+        size_t end = n - i > lanes * DARRAY_SIMD_COUNT_BLOCK ? i + lanes * DARRAY_SIMD_COUNT_BLOCK : n;\
+        for(; i + lanes <= end; i += lanes)\
+            acc = _sub(acc, _cmpeq(_mm256_loadu_si256((const __m256i *)&data[i]), v));\
+        _type counters[32 / sizeof(_type)];\
+        _mm256_storeu_si256((__m256i *)counters, acc);\
+        for(size_t j = 0; j < lanes; j++)\
+            count += (size_t)counters[j];\
+    }\
+    return count + _darray_count_##_sfx##_scalar(&data[i], n - i, val);\
+}\
+\
+__attribute__((target("avx2")))\
+static inline _type _darray_min_##_sfx##_avx2(const _type *data, size_t n){\
+    const size_t lanes = 32 / sizeof(_type);\
+    __m256i min = _set1(_darray_min_##_sfx##_scalar(data, 0));\
+    size_t i = 0;\
+    for(; i + lanes <= n; i += lanes)\
+        min = _min(min, _mm256_loadu_si256((const __m256i *)&data[i]));\
+    _type res[32 / sizeof(_type)];\
+    _mm256_storeu_si256((__m256i *)res, min);\
+    _type a = _darray_min_##_sfx##_scalar(res, lanes);\
+    _type b = _darray_min_##_sfx##_scalar(&data[i], n - i);\
+    return b < a ? b : a;\
+}\
+\
+__attribute__((target("avx2")))\
+static inline _type _darray_max_##_sfx##_avx2(const _type *data, size_t n){\
+    const size_t lanes = 32 / sizeof(_type);\
+    __m256i max = _set1(_darray_max_##_sfx##_scalar(data, 0));\
+    size_t i = 0;\
+    for(; i + lanes <= n; i += lanes)\
+        max = _max(max, _mm256_loadu_si256((const __m256i *)&data[i]));\
+    _type res[32 / sizeof(_type)];\
+    _mm256_storeu_si256((__m256i *)res, max);\
+    _type a = _darray_max_##_sfx##_scalar(res, lanes);\
+    _type b = _darray_max_##_sfx##_scalar(&data[i], n - i);\
+    return b > a ? b : a;\
+}\
+\
+__attribute__((target("avx2")))\
+static inline void _darray_fill_##_sfx##_avx2(_type *data, size_t n, _type val){\
+    const size_t lanes = 32 / sizeof(_type);\
+    __m256i v = _set1(val);\
+    size_t i = 0;\
+    for(; i + lanes <= n; i += lanes)\
+        _mm256_storeu_si256((__m256i *)&data[i], v);\
+    _darray_fill_##_sfx##_scalar(&data[i], n - i, val);\
+}\
+\
+__attribute__((target("avx2")))\
+static inline int _darray_equal_##_sfx##_avx2(const _type *a, const _type *b, size_t n){\
+    const size_t lanes = 32 / sizeof(_type);\
+    size_t i = 0;\
+    for(; i + lanes <= n; i += lanes){\
+        __m256i eq = _cmpeq(_mm256_loadu_si256((const __m256i *)&a[i]), _mm256_loadu_si256((const __m256i *)&b[i]));\
+        if(_mm256_movemask_epi8(eq) != -1)\
+            return 0;\
+    }\
+    return _darray_equal_##_sfx##_scalar(&a[i], &b[i], n - i);\
+}
+
+#define _darray_avx2_set1_32(_val) _mm256_set1_epi32((int32_t)(_val))
+#define _darray_avx2_set1_64(_val) _mm256_set1_epi64x((int64_t)(_val))
+
+_DARRAY_SIMD_AVX2_DEFINE(i32, int32_t, _darray_avx2_set1_32, _mm256_cmpeq_epi32, _mm256_min_epi32, _mm256_max_epi32, _mm256_sub_epi32)
+_DARRAY_SIMD_AVX2_DEFINE(u32, uint32_t, _darray_avx2_set1_32, _mm256_cmpeq_epi32, _mm256_min_epu32, _mm256_max_epu32, _mm256_sub_epi32)
+_DARRAY_SIMD_AVX2_DEFINE(i64, int64_t, _darray_avx2_set1_64, _mm256_cmpeq_epi64, _darray_avx2_min_epi64, _darray_avx2_max_epi64, _mm256_sub_epi64)
+_DARRAY_SIMD_AVX2_DEFINE(u64, uint64_t, _darray_avx2_set1_64, _mm256_cmpeq_epi64, _darray_avx2_min_epu64, _darray_avx2_max_epu64, _mm256_sub_epi64)
+
+/*
+ * Internal macro defining the AVX-512 kernels for _type. _wsfx names the
+ * lane width of the intrinsics (epi32, epi64) and _isfx the lane
+ * interpretation for min/max (epi32, epu32, epi64, epu64). The tails are
+ * handled with masked loads and stores.
+ */
+#define _DARRAY_SIMD_AVX512_DEFINE(_sfx, _type, _mask_t, _set1, _wsfx, _isfx)\
+static inline _mask_t _darray_mask_##_sfx##_avx512(size_t left){\
+    const size_t lanes = 64 / sizeof(_type);\
+    return (_mask_t)(left >= lanes ? (1u << lanes) - 1 : (1u << left) - 1);\
+}\
+\
+__attribute__((target("avx512f")))\
+static inline size_t _darray_find_##_sfx##_avx512(const _type *data, size_t n, _type val){\
+    __m512i v = _set1(val);\
+    for(size_t i = 0; i < n; i += 64 / sizeof(_type)){\
+        _mask_t load = _darray_mask_##_sfx##_avx512(n - i);\
+        _mask_t mask = _mm512_mask_cmpeq_##_wsfx##_mask(load, _mm512_maskz_loadu_##_wsfx(load, &data[i]), v);\
+        if(mask)\
+            return i + __builtin_ctz(mask);\
+    }\
+    return n;\
+}\
+\
+__attribute__((target("avx512f,popcnt")))\
+static inline size_t _darray_count_##_sfx##_avx512(const _type *data, size_t n, _type val){\
+    __m512i v = _set1(val);\
+    size_t count = 0;\
+    for(size_t i = 0; i < n; i += 64 / sizeof(_type)){\
+        _mask_t load = _darray_mask_##_sfx##_avx512(n - i);\
+        count += __builtin_popcount(_mm512_mask_cmpeq_##_wsfx##_mask(load, _mm512_maskz_loadu_##_wsfx(load, &data[i]), v));\
+    }\
+    return count;\
+}\
+\
+__attribute__((target("avx512f")))\
+static inline _type _darray_min_##_sfx##_avx512(const _type *data, size_t n){\
+    __m512i min = _set1(_darray_min_##_sfx##_scalar(data, 0));\
+    for(size_t i = 0; i < n; i += 64 / sizeof(_type)){\
+        _mask_t load = _darray_mask_##_sfx##_avx512(n - i);\
+        min = _mm512_mask_min_##_isfx(min, load, min, _mm512_maskz_loadu_##_wsfx(load, &data[i]));\
+    }\
+    return (_type)_mm512_reduce_min_##_isfx(min);\
+}\
+\
+__attribute__((target("avx512f")))\
+static inline _type _darray_max_##_sfx##_avx512(const _type *data, size_t n){\
+    __m512i max = _set1(_darray_max_##_sfx##_scalar(data, 0));\
+    for(size_t i = 0; i < n; i += 64 / sizeof(_type)){\
+        _mask_t load = _darray_mask_##_sfx##_avx512(n - i);\
+        max = _mm512_mask_max_##_isfx(max, load, max, _mm512_maskz_loadu_##_wsfx(load, &data[i]));\
+    }\
+    return (_type)_mm512_reduce_max_##_isfx(max);\
+}\
+\
+__attribute__((target("avx512f")))\
+static inline void _darray_fill_##_sfx##_avx512(_type *data, size_t n, _type val){\
+    __m512i v = _set1(val);\
+    for(size_t i = 0; i < n; i += 64 / sizeof(_type))\
+        _mm512_mask_storeu_##_wsfx(&data[i], _darray_mask_##_sfx##_avx512(n - i), v);\
+}\
+\
+__attribute__((target("avx512f")))\
+static inline int _darray_equal_##_sfx##_avx512(const _type *a, const _type *b, size_t n){\
+    for(size_t i = 0; i < n; i += 64 / sizeof(_type)){\
+        _mask_t load = _darray_mask_##_sfx##_avx512(n - i);\
+        if(_mm512_mask_cmpneq_##_wsfx##_mask(load, _mm512_maskz_loadu_##_wsfx(load, &a[i]), _mm512_maskz_loadu_##_wsfx(load, &b[i])))\
+            return 0;\
+    }\
+    return 1;\
+}
+
+#define _darray_avx512_set1_32(_val) _mm512_set1_epi32((int32_t)(_val))
+#define _darray_avx512_set1_64(_val) _mm512_set1_epi64((int64_t)(_val))
+
+_DARRAY_SIMD_AVX512_DEFINE(i32, int32_t, __mmask16, _darray_avx512_set1_32, epi32, epi32)
+_DARRAY_SIMD_AVX512_DEFINE(u32, uint32_t, __mmask16, _darray_avx512_set1_32, epi32, epu32)
+_DARRAY_SIMD_AVX512_DEFINE(i64, int64_t, __mmask8, _darray_avx512_set1_64, epi64, epi64)
+_DARRAY_SIMD_AVX512_DEFINE(u64, uint64_t, __mmask8, _darray_avx512_set1_64, epi64, epu64)
+
+#endif //DARRAY_SIMD_X86
+
+/*
+ * Instruction sets in the order of the kernel tables.
+ */
+#define DARRAY_SIMD_SCALAR 0
+#define DARRAY_SIMD_SSE2 1
+#define DARRAY_SIMD_AVX2 2
+#define DARRAY_SIMD_AVX512 3
+
+/*
+ * Returns the best instruction set of the cpu. It is detected at the first
+ * call, concurrent first calls detect the same value, so relaxed atomics are
+ * enough to make the cached value race free.
+ */
+static inline int darray_simd_level(void){
+#if DARRAY_SIMD_X86
+    static int cached = -1;
+    int level = __atomic_load_n(&cached, __ATOMIC_RELAXED);
+    if(level < 0){
+        __builtin_cpu_init();
+        if(__builtin_cpu_supports("avx512f"))
+            level = DARRAY_SIMD_AVX512;
+        else if(__builtin_cpu_supports("avx2"))
+            level = DARRAY_SIMD_AVX2;
+        else if(__builtin_cpu_supports("sse2"))
+            level = DARRAY_SIMD_SSE2;
+        else
+            level = DARRAY_SIMD_SCALAR;
+        __atomic_store_n(&cached, level, __ATOMIC_RELAXED);
+    }
+    return level;
+#else
+    return DARRAY_SIMD_SCALAR;
+#endif
+}
+
+/*
+ * Internal macro initializing the kernel table of _sfx for instruction set _isa.
+ */
+#define _DARRAY_SIMD_TABLE(_sfx, _isa) {\
+    _darray_find_##_sfx##_##_isa, _darray_count_##_sfx##_##_isa, _darray_min_##_sfx##_##_isa,\
+    _darray_max_##_sfx##_##_isa, _darray_fill_##_sfx##_##_isa, _darray_equal_##_sfx##_##_isa,\
+}
+
+/*
+ * Internal macro defining _darray_simd_##_sfx, which returns the kernels
+ * of _sfx for the instruction set darray_simd_level.
+ */
+#if DARRAY_SIMD_X86
+#define _DARRAY_SIMD_DISPATCH_DEFINE(_sfx)\
+static inline const struct darray_simd_##_sfx *_darray_simd_##_sfx(void){\
+    static const struct darray_simd_##_sfx tables[] = {\
+        _DARRAY_SIMD_TABLE(_sfx, scalar), _DARRAY_SIMD_TABLE(_sfx, sse2),\
+        _DARRAY_SIMD_TABLE(_sfx, avx2), _DARRAY_SIMD_TABLE(_sfx, avx512),\
+    };\
+    return &tables[darray_simd_level()];\
+}
+#else
+#define _DARRAY_SIMD_DISPATCH_DEFINE(_sfx)\
+static inline const struct darray_simd_##_sfx *_darray_simd_##_sfx(void){\
+    static const struct darray_simd_##_sfx scalar = _DARRAY_SIMD_TABLE(_sfx, scalar);\
+    return &scalar;\
+}
+#endif
+
+_DARRAY_SIMD_DISPATCH_DEFINE(i32)
+_DARRAY_SIMD_DISPATCH_DEFINE(u32)
+_DARRAY_SIMD_DISPATCH_DEFINE(i64)
+_DARRAY_SIMD_DISPATCH_DEFINE(u64)
+
+#endif //DARRAY_SIMD_H
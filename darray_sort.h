@@ -0,0 +1,396 @@
+/*
+Copyright (c) 2021 Christian Döring
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+#ifndef DARRAY_SORT_H
+#define DARRAY_SORT_H
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <pthread.h>
+#include <unistd.h>
+#include "darray.h"
+
+/*
+ * Sorting for darray, specialized per element type so the comparison inlines.
+ *
+ * DARRAY_SORT_DEFINE(_name, _type, _less) defines
+ *
+ *   int _name(darray(_type) *arr);
+ *       stable merge sort. Arrays with at least DARRAY_SORT_PARALLEL_THRESHOLD
+ *       elements per thread are split into one chunk per thread, the chunks
+ *       are sorted in parallel and then merged pairwise, every merge split
+ *       between the threads along the merge path.
+ *
+ *   int _name##_merge(darray(_type) *dst, darray(_type) *a, darray(_type) *b);
+ *       stable merge of the sorted darrays a and b into dst (which has to be
+ *       a different darray). Big merges are split between the threads.
+ *
+ * _less(a, b) is called with two pointers to _type and has to return
+ * non zero if *a has to be sorted before *b. It can be a function or a macro.
+ *
+ * DARRAY_RADIX_SORT_DEFINE(_name, _type, _key_type, _key) defines
+ *
+ *   int _name(darray(_type) *arr);
+ *       stable LSD radix sort by the unsigned integer _key(elem_p) of type
+ *       _key_type (one pass per byte of _key_type, passes in which all keys
+ *       have the same byte are skipped). Signed keys have to be mapped to
+ *       unsigned ones by flipping the sign bit.
+ *
+ * All functions return 1 if succes, 0 if the temporary buffer could not be
+ * allocated (the darray is left unchanged).
+ *
+ * Usage example:
+ *
+ *   #define int_less(_a, _b) (*(_a) < *(_b))
+ *   DARRAY_SORT_DEFINE(int_sort, int, int_less)
+ *
+ *   #define int_key(_a) ((uint32_t)*(_a) ^ 0x80000000u)
+ *   DARRAY_RADIX_SORT_DEFINE(int_radix_sort, int, uint32_t, int_key)
+ *
+ *   darray(int) test;
+ *   ...
+ *   int_sort(&test);
+ *   int_radix_sort(&test);
+ */
+
+/*
+ * Length of the runs that are sorted with insertion sort before merging.
+ */
+#ifndef DARRAY_SORT_RUN
+#define DARRAY_SORT_RUN 32
+#endif
+
+/*
+ * Minimum number of elements per thread for sorting or merging in parallel.
+ * Smaller arrays are sorted with fewer threads or in the calling thread.
+ */
+#ifndef DARRAY_SORT_PARALLEL_THRESHOLD
+#define DARRAY_SORT_PARALLEL_THRESHOLD ((size_t)1 << 15)
+#endif
+
+/*
+ * Number of threads used for parallel sorting (0 to use every online cpu).
+ * It is rounded down to a power of two and limited by DARRAY_SORT_MAX_THREADS.
+ */
+#ifndef DARRAY_SORT_THREADS
+#define DARRAY_SORT_THREADS 0
+#endif
+
+#ifndef DARRAY_SORT_MAX_THREADS
+#define DARRAY_SORT_MAX_THREADS 64
+#endif
+
+/*
+ * Internal function returning the maximum number of threads to sort with.
+ */
+static inline size_t _darray_sort_max_threads(void){
+    long cpus = DARRAY_SORT_THREADS > 0 ? (long)DARRAY_SORT_THREADS : sysconf(_SC_NPROCESSORS_ONLN);
+    size_t threads = 1;
+    while(threads * 2 <= (size_t)cpus && threads * 2 <= DARRAY_SORT_MAX_THREADS)
+        threads *= 2;
+    return threads;
+}
+
+/*
+ * Internal function returning the number of threads to sort n elements with,
+ * so every thread gets at least DARRAY_SORT_PARALLEL_THRESHOLD elements.
+ */
+static inline size_t _darray_sort_threads(size_t n){
+    size_t threads = _darray_sort_max_threads();
+    while(threads > 1 && n / threads < DARRAY_SORT_PARALLEL_THRESHOLD)
+        threads /= 2;
+    return threads;
+}
+
+/*
+ * The parallel tasks run on a pool of _darray_sort_max_threads() - 1 worker
+ * threads, which is started at the first parallel sort and then kept for the
+ * lifetime of the process (one pool per translation unit). The calling
+ * thread works on the tasks as well. The pool runs one sort at a time, the
+ * tasks of a sort started while the pool is busy run in its calling thread.
+ */
+struct _darray_sort_pool{
+    pthread_mutex_t lock, run;
+    pthread_cond_t work, done;
+    void (*fn)(void *);
+    uint8_t *tasks;
+    size_t task_size, n, next, pending;
+    unsigned long generation;
+};
+
+static inline struct _darray_sort_pool *_darray_sort_pool_get(void){
+    static struct _darray_sort_pool pool = {
+        .lock = PTHREAD_MUTEX_INITIALIZER, .run = PTHREAD_MUTEX_INITIALIZER,
+        .work = PTHREAD_COND_INITIALIZER, .done = PTHREAD_COND_INITIALIZER,
+    };
+    return &pool;
+}
+
+/*
+ * Internal function running the tasks of the current job until none is left.
+ * Has to be called with pool->lock held.
+ */
+static inline void _darray_sort_pool_drain(struct _darray_sort_pool *pool){
+    while(pool->next < pool->n){
+        void (*fn)(void *) = pool->fn;
+        void *task = pool->tasks + pool->next++ * pool->task_size;
+        pthread_mutex_unlock(&pool->lock);
+        fn(task);
+        pthread_mutex_lock(&pool->lock);
+        if(--pool->pending == 0)
+            pthread_cond_broadcast(&pool->done);
+    }
+}
+
+static inline void *_darray_sort_pool_worker(void *arg){
+    struct _darray_sort_pool *pool = (struct _darray_sort_pool *)arg;
+    unsigned long seen = 0;
+    pthread_mutex_lock(&pool->lock);
+    for(;;){
+        while(pool->generation == seen)
+            pthread_cond_wait(&pool->work, &pool->lock);
+        seen = pool->generation;
+        _darray_sort_pool_drain(pool);
+    }
+    return NULL;
+}
+
+static inline void _darray_sort_pool_start(void){
+    struct _darray_sort_pool *pool = _darray_sort_pool_get();
+    for(size_t i = 1; i < _darray_sort_max_threads(); i++){
+        pthread_t thread;
+        // Workers that can not be created are missing, the calling thread runs their share.
+        if(pthread_create(&thread, NULL, _darray_sort_pool_worker, pool) == 0)
+            pthread_detach(thread);
+    }
+}
+
+/*
+ * Internal function running fn on each of the n tasks of task_size bytes
+ * on the pool and the calling thread. Returns when all tasks are done.
+ */
+static inline void _darray_sort_run(void (*fn)(void *), void *tasks, size_t task_size, size_t n){
+    static pthread_once_t once = PTHREAD_ONCE_INIT;
+    struct _darray_sort_pool *pool = _darray_sort_pool_get();
+    pthread_once(&once, _darray_sort_pool_start);
+    if(pthread_mutex_trylock(&pool->run) != 0){
+        for(size_t i = 0; i < n; i++)
+            fn((uint8_t *)tasks + i * task_size);
+        return;
+    }
+    pthread_mutex_lock(&pool->lock);
+    pool->fn = fn;
+    pool->tasks = (uint8_t *)tasks;
+    pool->task_size = task_size;
+    pool->n = n;
+    pool->next = 0;
+    pool->pending = n;
+    pool->generation++;
+    pthread_cond_broadcast(&pool->work);
+    _darray_sort_pool_drain(pool);
+    while(pool->pending > 0)
+        pthread_cond_wait(&pool->done, &pool->lock);
+    pthread_mutex_unlock(&pool->lock);
+    pthread_mutex_unlock(&pool->run);
+}
+
+/*
+ * Defines the merge sort _name and the merge _name##_merge for darray(_type).
+ */
+#define DARRAY_SORT_DEFINE(_name, _type, _less)\
+static inline void _name##_insertion(_type *data, size_t n){\
+    for(size_t i = 1; i < n; i++){\
+        _type tmp = data[i];\
+        size_t j = i;\
+        for(; j > 0 && _less(&tmp, &data[j-1]); j--)\
+            data[j] = data[j-1];\
+        data[j] = tmp;\
+    }\
+}\
+\
+static inline void _name##_merge_into(const _type *a, size_t na, const _type *b, size_t nb, _type *out){\
+    size_t i = 0, j = 0, k = 0;\
+    while(i < na && j < nb){\
+        if(_less(&b[j], &a[i]))\
+            out[k++] = b[j++];\
+        else\
+            out[k++] = a[i++];\
+    }\
+    memcpy(&out[k], &a[i], (na - i) * sizeof(_type));\
+    memcpy(&out[k + na - i], &b[j], (nb - j) * sizeof(_type));\
+}\
+\
+static inline size_t _name##_corank(const _type *a, size_t na, const _type *b, size_t nb, size_t k){\
+    size_t lo = k > nb ? k - nb : 0, hi = k < na ? k : na;\
+    while(lo < hi){\
+        size_t i = lo + (hi - lo) / 2, j = k - i;\
+        if(j > 0 && i < na && !_less(&b[j-1], &a[i]))\
+            lo = i + 1;\
+        else\
+            hi = i;\
+    }\
+    return lo;\
+}\
+\
+static inline void _name##_sort_seq(_type *data, _type *tmp, size_t n){\
+    for(size_t i = 0; i < n; i += DARRAY_SORT_RUN)\
+        _name##_insertion(&data[i], n - i < DARRAY_SORT_RUN ? n - i : DARRAY_SORT_RUN);\
+    _type *src = data, *dst = tmp;\
+    for(size_t width = DARRAY_SORT_RUN; width < n; width *= 2){\
+        for(size_t i = 0; i < n; i += 2 * width){\
+            size_t na = n - i < width ? n - i : width;\
+            size_t nb = n - i - na < width ? n - i - na : width;\
+            _name##_merge_into(&src[i], na, &src[i + na], nb, &dst[i]);\
+        }\
+        _type *swap = src; src = dst; dst = swap;\
+    }\
+    if(src != data)\
+        memcpy(data, src, n * sizeof(_type));\
+}\
+\
+struct _name##_task{\
+    const _type *a, *b;\
+    _type *out, *tmp;\
+    size_t na, nb, part, parts;\
+};\
+\
+static void _name##_sort_task(void *arg){\
+    struct _name##_task *task = (struct _name##_task *)arg;\
+    _name##_sort_seq(task->out, task->tmp, task->na);\
+}\
+\
+static void _name##_merge_task(void *arg){\
+    struct _name##_task *task = (struct _name##_task *)arg;\
+    size_t n = task->na + task->nb;\
+    size_t k0 = n * task->part / task->parts, k1 = n * (task->part + 1) / task->parts;\
+    size_t i0 = _name##_corank(task->a, task->na, task->b, task->nb, k0);\
+    size_t i1 = _name##_corank(task->a, task->na, task->b, task->nb, k1);\
+    _name##_merge_into(&task->a[i0], i1 - i0, &task->b[k0 - i0], (k1 - i1) - (k0 - i0), &task->out[k0]);\
+}\
+\
+static inline void _name##_sort_par(_type *data, _type *tmp, size_t n, size_t threads){\
+    struct _name##_task tasks[DARRAY_SORT_MAX_THREADS] = {{0}};\
+    size_t chunk = (n + threads - 1) / threads;\
+    for(size_t t = 0; t < threads; t++){\
+        size_t begin = t * chunk < n ? t * chunk : n;\
+        tasks[t].out = &data[begin];\
+        tasks[t].tmp = &tmp[begin];\
+        tasks[t].na = n - begin < chunk ? n - begin : chunk;\
+    }\
+    _darray_sort_run(_name##_sort_task, tasks, sizeof(struct _name##_task), threads);\
+    _type *src = data, *dst = tmp;\
+    for(size_t width = chunk; width < n; width *= 2){\
+        size_t pairs = (n + 2 * width - 1) / (2 * width), parts = threads / pairs, t = 0;\
+        for(size_t i = 0; i < n; i += 2 * width){\
+            size_t na = n - i < width ? n - i : width;\
+            size_t nb = n - i - na < width ? n - i - na : width;\
+            for(size_t part = 0; part < parts; part++, t++){\
+                tasks[t].a = &src[i];\
+                tasks[t].b = &src[i + na];\
+                tasks[t].out = &dst[i];\
+                tasks[t].na = na;\
+                tasks[t].nb = nb;\
+                tasks[t].part = part;\
+                tasks[t].parts = parts;\
+            }\
+        }\
+        _darray_sort_run(_name##_merge_task, tasks, sizeof(struct _name##_task), t);\
+        _type *swap = src; src = dst; dst = swap;\
+    }\
+    if(src != data)\
+        memcpy(data, src, n * sizeof(_type));\
+}\
+\
+static inline int _name(_type **arr){\
+    size_t n = darray_size(arr), threads = _darray_sort_threads(n);\
+    _type *tmp;\
+    if(n <= DARRAY_SORT_RUN){\
+        _name##_insertion(*arr, n);\
+        return 1;\
+    }\
+    if((tmp = (_type *)malloc(n * sizeof(_type))) == NULL)\
+        return 0;\
+    if(threads > 1)\
+        _name##_sort_par(*arr, tmp, n, threads);\
+    else\
+        _name##_sort_seq(*arr, tmp, n);\
+    free(tmp);\
+    return 1;\
+}\
+\
+static inline int _name##_merge(_type **dst, _type **a, _type **b){\
+    size_t na = darray_size(a), nb = darray_size(b), threads = _darray_sort_threads(na + nb);\
+    if(!darray_reserve(dst, na + nb))\
+        return 0;\
+    if(threads > 1){\
+        struct _name##_task tasks[DARRAY_SORT_MAX_THREADS];\
+        for(size_t t = 0; t < threads; t++){\
+            tasks[t].a = *a;\
+            tasks[t].b = *b;\
+            tasks[t].out = *dst;\
+            tasks[t].na = na;\
+            tasks[t].nb = nb;\
+            tasks[t].part = t;\
+            tasks[t].parts = threads;\
+        }\
+        _darray_sort_run(_name##_merge_task, tasks, sizeof(struct _name##_task), threads);\
+    }\
+    else\
+        _name##_merge_into(*a, na, *b, nb, *dst);\
+    DARRAY_HEADER(*dst)->size = (na + nb) * sizeof(_type);\
+    return 1;\
+}
+
+/*
+ * Defines the radix sort _name for darray(_type) by the key _key(elem_p) of type _key_type.
+ */
+#define DARRAY_RADIX_SORT_DEFINE(_name, _type, _key_type, _key)\
+static inline int _name(_type **arr){\
+    size_t n = darray_size(arr);\
+    size_t count[256];\
+    _type *src = *arr, *dst;\
+    if(n < 2)\
+        return 1;\
+    if((dst = (_type *)malloc(n * sizeof(_type))) == NULL)\
+        return 0;\
+    for(unsigned shift = 0; shift < sizeof(_key_type) * 8; shift += 8){\
+        memset(count, 0, sizeof(count));\
+        for(size_t i = 0; i < n; i++)\
+            count[(size_t)((_key(&src[i])) >> shift) & 0xff]++;\
+        if(count[(size_t)((_key(&src[0])) >> shift) & 0xff] == n)\
+            continue;\
+        for(size_t i = 0, sum = 0; i < 256; i++){\
+            size_t c = count[i];\
+            count[i] = sum;\
+            sum += c;\
+        }\
+        for(size_t i = 0; i < n; i++)\
+            dst[count[(size_t)((_key(&src[i])) >> shift) & 0xff]++] = src[i];\
+        _type *swap = src; src = dst; dst = swap;\
+    }\
+    if(src != *arr){\
+        memcpy(*arr, src, n * sizeof(_type));\
+        dst = src;\
+    }\
+    free(dst);\
+    return 1;\
+}
+
+#endif //DARRAY_SORT_H
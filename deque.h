@@ -0,0 +1,290 @@
+/*
+   Copyright (c) 2021 Christian Döring
+   Permission is hereby granted, free of charge, to any person obtaining a copy
+   of this software and associated documentation files (the "Software"), to deal
+   in the Software without restriction, including without limitation the rights
+   to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+   copies of the Software, and to permit persons to whom the Software is
+   furnished to do so, subject to the following conditions:
+   The above copyright notice and this permission notice shall be included in all
+   copies or substantial portions of the Software.
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+   IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+   FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+   AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+   LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+   OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+   SOFTWARE.
+   */
+
+#ifndef DEQUE_H
+#define DEQUE_H
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+
+/*
+ * struct deque is a segmented array of fixed size elements. The elements
+ * live in chunks of a power of two elements and a ring of chunk pointers
+ * (map) keeps the chunks in order:
+ *
+ *        map
+ * +---+---+---+---+
+ * | 0 | # | # | # |
+ * +---+---+---+---+
+ *       |   |   |
+ *       |   |   +-> +---+---+---+---+
+ *       |   |       | # | # | 0 | 0 |
+ *       |   |       +---+---+---+---+
+ *       |   +-----> +---+---+---+---+
+ *       |           | # | # | # | # |
+ *       |           +---+---+---+---+
+ *       +---------> +---+---+---+---+
+ *                   | 0 | # | # | # |
+ *                   +---+---+---+---+
+ *                         ^
+ *                         |
+ *                       first
+ *
+ * Element i is in chunk (first + i) / chunk_size at (first + i) % chunk_size,
+ * both are a shift and a mask. Pushing and popping at either end only
+ * allocates or frees a chunk at the ends of the ring. When the ring is full
+ * only the chunk pointers are copied into a bigger one, so elements are never
+ * moved and pointers to them stay valid until they are popped.
+ *
+ * One chunk that became empty is kept as spare, so pushing and popping
+ * around a chunk boundary does not call malloc and free every time.
+ *
+ * Usage example:
+ *
+ *   struct deque d;
+ *   deque_init(&d, int, 256);
+ *
+ *   int i = 1;
+ *   deque_push_back(&d, &i);
+ *   deque_push_front(&d, &i);
+ *
+ *   for(size_t j = 0; j < deque_size(&d); j++)
+ *       printf("%i\n", DEQUE_AT(&d, int, j));
+ *
+ *   deque_pop_front(&d, &i);
+ *
+ *   deque_free(&d);
+ */
+struct deque {
+    uint8_t **map;
+    uint8_t *spare;
+    size_t map_mask, first, size;
+    size_t elem_size, chunk_shift;
+};
+
+/*
+ * Initializes the deque for elements of _type.
+ *
+ * @param _self: pointer to the deque
+ * @param _type: type of the elements
+ * @param _chunk: elements per chunk, rounded up to a power of two
+ *
+ * @return pointer to the deque (NULL if failed)
+ */
+#define deque_init(_self, _type, _chunk) _deque_init(_self, sizeof(_type), _chunk)
+
+/*
+ * Element at index _i as an lvalue of _type.
+ */
+#define DEQUE_AT(_self, _type, _i) (*(_type *)deque_at(_self, _i))
+
+/*
+ * Initial number of chunk pointers in the map.
+ */
+#define DEQUE_MAP_INIT 8
+
+static inline struct deque *_deque_init(struct deque *self, size_t elem_size, size_t chunk){
+    self->chunk_shift = 0;
+    while(((size_t)1 << self->chunk_shift) < chunk)
+        self->chunk_shift++;
+    if((self->map = (uint8_t **)calloc(DEQUE_MAP_INIT, sizeof(uint8_t *))) == NULL)
+        return NULL;
+    self->map_mask = DEQUE_MAP_INIT - 1;
+    self->spare = NULL;
+    self->first = 0;
+    self->size = 0;
+    self->elem_size = elem_size;
+    return self;
+}
+
+/*
+ * Returns the number of elements in the deque.
+ */
+static inline size_t deque_size(struct deque *self){
+    return self->size;
+}
+
+/*
+ * Internal function returning the map slot of the chunk holding position pos.
+ */
+static inline uint8_t **_deque_slot(struct deque *self, size_t pos){
+    return &self->map[(pos >> self->chunk_shift) & self->map_mask];
+}
+
+/*
+ * Internal function returning the element at position pos.
+ */
+static inline void *_deque_elem(struct deque *self, size_t pos){
+    return *_deque_slot(self, pos) + (pos & (((size_t)1 << self->chunk_shift) - 1)) * self->elem_size;
+}
+
+/*
+ * Returns a pointer to the element at index.
+ * The index is not checked (index < deque_size).
+ */
+static inline void *deque_at(struct deque *self, size_t index){
+    return _deque_elem(self, self->first + index);
+}
+
+/*
+ * Internal function doubling the map if first and size + 1 elements need
+ * more chunks than it has. The chunks are placed at the start of the new
+ * map in order.
+ *
+ * @return 1 if success, 0 if failed
+ */
+static inline int _deque_reserve_map(struct deque *self, size_t first){
+    size_t chunk_mask = ((size_t)1 << self->chunk_shift) - 1;
+    size_t chunks = ((first & chunk_mask) + self->size + 1 + chunk_mask) >> self->chunk_shift;
+    if(chunks <= self->map_mask + 1)
+        return 1;
+
+    size_t cap = (self->map_mask + 1) * 2;
+    uint8_t **map;
+    if((map = (uint8_t **)calloc(cap, sizeof(uint8_t *))) == NULL)
+        return 0;
+    for(size_t i = 0; i <= self->map_mask; i++)
+        map[i] = *_deque_slot(self, self->first + (i << self->chunk_shift));
+    free(self->map);
+    self->map = map;
+    self->map_mask = cap - 1;
+    self->first &= chunk_mask;
+    return 1;
+}
+
+/*
+ * Internal function returning the element at position pos, allocates its chunk if needed.
+ */
+static inline void *_deque_alloc_elem(struct deque *self, size_t pos){
+    uint8_t **slot = _deque_slot(self, pos);
+    if(*slot == NULL){
+        if(self->spare != NULL){
+            *slot = self->spare;
+            self->spare = NULL;
+        }
+        else if((*slot = (uint8_t *)malloc(self->elem_size << self->chunk_shift)) == NULL)
+            return NULL;
+    }
+    return _deque_elem(self, pos);
+}
+
+/*
+ * Internal function releasing the chunk holding position pos.
+ */
+static inline void _deque_release(struct deque *self, size_t pos){
+    uint8_t **slot = _deque_slot(self, pos);
+    if(self->spare == NULL)
+        self->spare = *slot;
+    else
+        free(*slot);
+    *slot = NULL;
+}
+
+/*
+ * Internal function returning the position before pos in the ring.
+ */
+static inline size_t _deque_prev(struct deque *self, size_t pos){
+    return (pos - 1) & (((self->map_mask + 1) << self->chunk_shift) - 1);
+}
+
+/*
+ * Pushes a copy of the element at elem to the back of the deque.
+ *
+ * @return int: 1 if succes, 0 if failed
+ */
+static inline int deque_push_back(struct deque *self, const void *elem){
+    void *dst;
+    if(!_deque_reserve_map(self, self->first))
+        return 0;
+    if((dst = _deque_alloc_elem(self, self->first + self->size)) == NULL)
+        return 0;
+    memcpy(dst, elem, self->elem_size);
+    self->size++;
+    return 1;
+}
+
+/*
+ * Pushes a copy of the element at elem to the front of the deque.
+ *
+ * @return int: 1 if succes, 0 if failed
+ */
+static inline int deque_push_front(struct deque *self, const void *elem){
+    void *dst;
+    if(!_deque_reserve_map(self, _deque_prev(self, self->first)))
+        return 0;
+    size_t first = _deque_prev(self, self->first);
+    if((dst = _deque_alloc_elem(self, first)) == NULL)
+        return 0;
+    memcpy(dst, elem, self->elem_size);
+    self->first = first;
+    self->size++;
+    return 1;
+}
+
+/*
+ * Pops the back of the deque into elem (may be NULL).
+ *
+ * @return int: 1 if succes, 0 if the deque was empty
+ */
+static inline int deque_pop_back(struct deque *self, void *elem){
+    if(self->size == 0)
+        return 0;
+    self->size--;
+    size_t pos = self->first + self->size;
+    if(elem != NULL)
+        memcpy(elem, _deque_elem(self, pos), self->elem_size);
+    if((pos & (((size_t)1 << self->chunk_shift) - 1)) == 0)
+        _deque_release(self, pos);
+    return 1;
+}
+
+/*
+ * Pops the front of the deque into elem (may be NULL).
+ *
+ * @return int: 1 if succes, 0 if the deque was empty
+ */
+static inline int deque_pop_front(struct deque *self, void *elem){
+    if(self->size == 0)
+        return 0;
+    size_t pos = self->first;
+    if(elem != NULL)
+        memcpy(elem, _deque_elem(self, pos), self->elem_size);
+    self->first = (pos + 1) & (((self->map_mask + 1) << self->chunk_shift) - 1);
+    self->size--;
+    if((self->first & (((size_t)1 << self->chunk_shift) - 1)) == 0)
+        _deque_release(self, pos);
+    return 1;
+}
+
+/*
+ * Frees all chunks and the map of the deque.
+ */
+static inline void deque_free(struct deque *self){
+    for(size_t i = 0; i <= self->map_mask; i++)
+        free(self->map[i]);
+    free(self->spare);
+    free(self->map);
+    self->map = NULL;
+    self->spare = NULL;
+    self->size = 0;
+}
+
+#endif //DEQUE_H
@@ -88,6 +88,116 @@ struct dlist{
     struct dlist *next, *prev;
 };
 
+/*
+ * Number of nodes the prefetching iterators run ahead of the current node.
+ * Should cover the memory latency with the work of the loop body, a larger
+ * distance helps for short bodies.
+ */
+#ifndef DLIST_PREFETCH_DISTANCE
+#define DLIST_PREFETCH_DISTANCE 4
+#endif
+
+/*
+ * Iterate over the list like dlist_foreach and dlist_foreach_cont, while a
+ * second pointer walks DLIST_PREFETCH_DISTANCE nodes ahead and prefetches
+ * the nodes it reaches. The body must not remove nodes from the list.
+ *
+ * The lookahead pointer walks the same chain of dependent next loads, so the
+ * misses still happen one after the other. Prefetching only overlaps them
+ * with the work of the body: with a body that takes about as long as a miss
+ * the iteration over a shuffled list larger than the cache gets faster
+ * (about 30% in bench/dlist_prefetch.c), with a short body it is as fast as
+ * dlist_foreach or slower.
+ *
+ * @param _iter_p: pointer to the iterator
+ * @param _list_p: pointer to the list to iterate over
+ */
+#define dlist_foreach_prefetch(_iter_p, _list_p)\
+    for(struct dlist *_dlist_ahead = _dlist_prefetch_ahead((_list_p)->next, (_list_p), DLIST_PREFETCH_DISTANCE);\
+        _dlist_ahead != NULL; _dlist_ahead = NULL)\
+        for((_iter_p) = (_list_p)->next; (_iter_p) != (_list_p);\
+            (_iter_p) = (_iter_p)->next, _dlist_ahead = _dlist_prefetch_ahead(_dlist_ahead, (_list_p), 1))
+
+#define dlist_foreach_cont_prefetch(_iter_p, _list_p, _member)\
+    for(struct dlist *_dlist_ahead = _dlist_prefetch_ahead((_list_p)->next, (_list_p), DLIST_PREFETCH_DISTANCE);\
+        _dlist_ahead != NULL; _dlist_ahead = NULL)\
+        for((_iter_p) = container_of((_list_p)->next, typeof(*(_iter_p)), _member);\
+            &((_iter_p)->_member) != (_list_p);\
+            (_iter_p) = container_of((_iter_p)->_member.next, typeof(*(_iter_p)), _member),\
+            _dlist_ahead = _dlist_prefetch_ahead(_dlist_ahead, (_list_p), 1))
+
+/*
+ * Iterate over the list in batches. _nodes is an array of struct dlist
+ * pointers, every pass of the body gets up to the length of the array nodes
+ * in _nodes[0] ... _nodes[_count - 1]. The body may remove the nodes of the
+ * current batch.
+ *
+ * The batch is collected by walking next one node at a time, so collecting
+ * it takes the same chain of misses as dlist_foreach and the misses do not
+ * overlap with the body. It is no faster than dlist_foreach, use it when the
+ * body needs several nodes at once.
+ *
+ * Usage example:
+ *
+ *   struct dlist *nodes[16];
+ *   size_t count;
+ *   dlist_foreach_batch(nodes, count, &list){
+ *       for(size_t i = 0; i < count; i++)
+ *           sum += container_of(nodes[i], struct test, node)->i;
+ *   }
+ *
+ * @param _nodes: array of struct dlist pointers (not a pointer to one, its
+ *          length is taken with sizeof, which is checked at compile time)
+ * @param _count: name of the size_t receiving the number of nodes in the batch
+ * @param _list_p: pointer to the list to iterate over
+ */
+#define dlist_foreach_batch(_nodes, _count, _list_p)\
+    for(struct dlist *_dlist_pos = (_list_p)->next;\
+        ((_count) = dlist_batch((_list_p), &_dlist_pos, (_nodes), _DLIST_ARRAY_SIZE(_nodes))) > 0;)
+
+/*
+ * Internal macro returning the length of the array _arr. Fails to compile if
+ * _arr is a pointer, for which sizeof would silently give a wrong length.
+ */
+#define _DLIST_ARRAY_SIZE(_arr)\
+    (sizeof(_arr) / sizeof(*(_arr)) + 0 * sizeof(struct{\
+        _Static_assert(!__builtin_types_compatible_p(typeof(_arr), typeof(&(_arr)[0])), #_arr " is not an array");\
+        int _dummy;\
+    }))
+
+/*
+ * Internal function advancing node by up to distance nodes, without passing
+ * the head list, and prefetching every node it reaches.
+ */
+static inline struct dlist *_dlist_prefetch_ahead(struct dlist *node, struct dlist *list, unsigned distance){
+    for(; distance > 0 && node != list; distance--){
+        node = node->next;
+        __builtin_prefetch(node);
+    }
+    return node;
+}
+
+/*
+ * dlist_batch collects up to count nodes of list, starting at *pos, into nodes.
+ * *pos is set to the node after the batch.
+ *
+ * @param list: pointer to the list
+ * @param pos: pointer to the first node of the batch, list->next for the first batch
+ * @param nodes: array receiving the nodes
+ * @param count: length of nodes
+ * @return number of nodes in the batch, 0 if *pos is the end of the list
+ */
+static inline size_t dlist_batch(struct dlist *list, struct dlist **pos, struct dlist **nodes, size_t count){
+    struct dlist *node = *pos;
+    size_t i = 0;
+    for(; i < count && node != list; i++){
+        nodes[i] = node;
+        node = node->next;
+    }
+    *pos = node;
+    return i;
+}
+
 /*
  * dlist_init initializes list (next = prev = self)
  *
@@ -251,4 +361,152 @@ static inline void dlist_reverse(struct dlist *self){
         node->prev = tmp;
     }
 }
+
+/*
+ * dlist_counted is the head of a doubly linked list that keeps track of its
+ * length. Nodes are plain struct dlist, only the head carries the count, so
+ * the nodes of a counted list have the same size as those of a plain one.
+ * Nodes of a counted list must only be added and removed through the
+ * dlist_counted_* functions, every dlist_foreach* macro works on &self->list.
+ */
+struct dlist_counted{
+    struct dlist list;
+    size_t length;
+};
+
+/*
+ * dlist_counted_init initializes an empty counted list
+ *
+ * @param self pointer to the counted list
+ * @return self
+ */
+static inline struct dlist_counted *dlist_counted_init(struct dlist_counted *self){
+    dlist_init(&self->list);
+    self->length = 0;
+    return self;
+}
+
+/*
+ * dlist_counted_length returns the length of the list in O(1)
+ *
+ * @param self pointer to the counted list
+ * @return length of the list
+ */
+static inline size_t dlist_counted_length(struct dlist_counted *self){
+    return self->length;
+}
+
+/*
+ * dlist_counted_push_after pushes src after the node dst of the list
+ *
+ * @param self pointer to the counted list
+ * @param dst node of the list (or &self->list) after which to push src
+ * @param src node to push after dst
+ * @return src if success NULL else
+ */
+static inline struct dlist *dlist_counted_push_after(struct dlist_counted *self, struct dlist *dst, struct dlist *src){
+    if(dlist_push_after(dst, src) == NULL)
+        return NULL;
+    self->length++;
+    return src;
+}
+
+/*
+ * dlist_counted_push_before pushes src before the node dst of the list
+ *
+ * @param self pointer to the counted list
+ * @param dst node of the list (or &self->list) before which to push src
+ * @param src node to push before dst
+ * @return src if success NULL else
+ */
+static inline struct dlist *dlist_counted_push_before(struct dlist_counted *self, struct dlist *dst, struct dlist *src){
+    if(dlist_push_before(dst, src) == NULL)
+        return NULL;
+    self->length++;
+    return src;
+}
+
+/*
+ * dlist_counted_push_back pushes src at the back of the list
+ *
+ * @param self pointer to the counted list
+ * @param src node to push
+ * @return src if success NULL else
+ */
+static inline struct dlist *dlist_counted_push_back(struct dlist_counted *self, struct dlist *src){
+    return dlist_counted_push_after(self, self->list.prev, src);
+}
+
+/*
+ * dlist_counted_push_front pushes src at the front of the list
+ *
+ * @param self pointer to the counted list
+ * @param src node to push
+ * @return src if success NULL else
+ */
+static inline struct dlist *dlist_counted_push_front(struct dlist_counted *self, struct dlist *src){
+    return dlist_counted_push_before(self, self->list.next, src);
+}
+
+/*
+ * dlist_counted_pop pops target from the list
+ *
+ * @param self pointer to the counted list
+ * @param target node of the list to be poped, must not be &self->list
+ * @return target if success NULL else
+ */
+static inline struct dlist *dlist_counted_pop(struct dlist_counted *self, struct dlist *target){
+    if(target == &self->list || dlist_pop(target) == NULL)
+        return NULL;
+    self->length--;
+    return target;
+}
+
+/*
+ * dlist_counted_pop_front pops the first node of the list
+ *
+ * @param self pointer to the counted list
+ * @return the first node, NULL if the list is empty
+ */
+static inline struct dlist *dlist_counted_pop_front(struct dlist_counted *self){
+    return dlist_counted_pop(self, self->list.next);
+}
+
+/*
+ * dlist_counted_pop_back pops the last node of the list
+ *
+ * @param self pointer to the counted list
+ * @return the last node, NULL if the list is empty
+ */
+static inline struct dlist *dlist_counted_pop_back(struct dlist_counted *self){
+    return dlist_counted_pop(self, self->list.prev);
+}
+
+/*
+ * dlist_counted_splice_after inserts the nodes of src after the node dst of self. Src will be empty.
+ *
+ * @param self pointer to the counted list containing dst
+ * @param dst node of self (or &self->list) after which to insert the nodes of src
+ * @param src counted list, whichs nodes are to be inserted after dst
+ * @return first element that has been inserted, if src is empty dst->next
+ */
+static inline struct dlist *dlist_counted_splice_after(struct dlist_counted *self, struct dlist *dst, struct dlist_counted *src){
+    self->length += src->length;
+    src->length = 0;
+    return dlist_splice_after(dst, &src->list);
+}
+
+/*
+ * dlist_counted_splice_before inserts the nodes of src before the node dst of self. Src will be empty.
+ *
+ * @param self pointer to the counted list containing dst
+ * @param dst node of self (or &self->list) before which to insert the nodes of src
+ * @param src counted list, whichs nodes are to be inserted before dst
+ * @return dst->next
+ */
+static inline struct dlist *dlist_counted_splice_before(struct dlist_counted *self, struct dlist *dst, struct dlist_counted *src){
+    self->length += src->length;
+    src->length = 0;
+    return dlist_splice_before(dst, &src->list);
+}
 #endif //DLIST_H
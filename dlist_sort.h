@@ -0,0 +1,218 @@
+/*
+   Copyright (c) 2021 Christian Döring
+   Permission is hereby granted, free of charge, to any person obtaining a copy
+   of this software and associated documentation files (the "Software"), to deal
+   in the Software without restriction, including without limitation the rights
+   to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+   copies of the Software, and to permit persons to whom the Software is
+   furnished to do so, subject to the following conditions:
+   The above copyright notice and this permission notice shall be included in all
+   copies or substantial portions of the Software.
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+   IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+   FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+   AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+   LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+   OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+   SOFTWARE.
+   */
+
+#ifndef DLIST_SORT_H
+#define DLIST_SORT_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "dlist.h"
+#include "mdlist.h"
+
+/*
+ * Sorting for dlist and MDLIST, specialized per container type so the
+ * comparison inlines.
+ *
+ * DLIST_SORT_DEFINE(_name, _type, _member, _less) defines
+ *
+ *   void _name(struct dlist *list);
+ *       stable merge sort of a list of _type linked by _member.
+ *
+ *   void _name##_merge(struct dlist *dst, struct dlist *src);
+ *       stable merge of the sorted list src into the sorted list dst in O(n),
+ *       on equal elements those of dst come first. src will be empty.
+ *
+ * MDLIST_SORT_DEFINE(_name, _type, _field, _less) defines the same for an
+ * MDLIST(_type, _field), the functions take pointers to the MDLIST. Like for
+ * the other MDLIST macros the ENTRY _field has to be the first member of _type.
+ *
+ * _less(a, b) is called with two pointers to _type and has to return
+ * non zero if *a has to be sorted before *b. It can be a function or a macro.
+ *
+ * The sort is bottom-up and relinks the nodes in place, nothing is
+ * allocated. The nodes are first linked into a NULL terminated chain by next.
+ * Every node is merged with the pending runs like a binary counter: pending[i]
+ * is either empty or a sorted run of 2^i nodes, so equally long runs are
+ * merged while they are still in the cache. Afterwards the prev pointers are
+ * restored in one pass.
+ *
+ * Usage example:
+ *
+ *   struct test{
+ *       struct dlist node;
+ *       int i;
+ *   };
+ *
+ *   #define test_less(_a, _b) ((_a)->i < (_b)->i)
+ *   DLIST_SORT_DEFINE(test_sort, struct test, node, test_less)
+ *
+ *   struct dlist list;
+ *   ...
+ *   test_sort(&list);
+ */
+
+/*
+ * Internal function restoring the prev pointers and the cycle of list from
+ * the NULL terminated chain first.
+ */
+static inline void _dlist_sort_relink(struct dlist *list, struct dlist *first){
+    struct dlist *prev = list;
+    for(; first != NULL; first = first->next){
+        prev->next = first;
+        first->prev = prev;
+        prev = first;
+    }
+    prev->next = list;
+    list->prev = prev;
+}
+
+/*
+ * Internal macro generating the chain merge and the bottom-up sort on the
+ * NULL terminated chain of _node_type linked by _NEXT(node). _LESS(a, b)
+ * compares two nodes.
+ */
+#define _DLIST_SORT_CHAIN_DEFINE(_name, _node_type, _NEXT, _LESS)\
+static inline _node_type *_name##_merge_chain(_node_type *a, _node_type *b){\
+    _node_type *head = NULL, **tail = &head;\
+    while(a != NULL && b != NULL){\
+        if(_LESS(b, a)){\
+            *tail = b;\
+            b = _NEXT(b);\
+        }\
+        else{\
+            *tail = a;\
+            a = _NEXT(a);\
+        }\
+        tail = &_NEXT(*tail);\
+    }\
+    *tail = a != NULL ? a : b;\
+    return head;\
+}\
+\
+static inline _node_type *_name##_sort_chain(_node_type *node){\
+    _node_type *pending[sizeof(size_t) * 8] = {NULL};\
+    _node_type *next, *run;\
+    size_t i, top = 0;\
+    for(; node != NULL; node = next){\
+        next = _NEXT(node);\
+        _NEXT(node) = NULL;\
+        run = node;\
+        for(i = 0; pending[i] != NULL; i++){\
+            run = _name##_merge_chain(pending[i], run);\
+            pending[i] = NULL;\
+        }\
+        pending[i] = run;\
+        if(i >= top)\
+            top = i + 1;\
+    }\
+    run = NULL;\
+    for(i = 0; i < top; i++){\
+        if(pending[i] != NULL)\
+            run = _name##_merge_chain(pending[i], run);\
+    }\
+    return run;\
+}
+
+#define _DLIST_SORT_NEXT(_node) ((_node)->next)
+
+/*
+ * Defines the merge sort _name and the merge _name##_merge for a dlist of _type linked by _member.
+ */
+#define DLIST_SORT_DEFINE(_name, _type, _member, _less)\
+\
+static inline int _name##_less_node(struct dlist *a, struct dlist *b){\
+    return _less((const _type *)container_of(a, _type, _member), (const _type *)container_of(b, _type, _member));\
+}\
+\
+_DLIST_SORT_CHAIN_DEFINE(_name, struct dlist, _DLIST_SORT_NEXT, _name##_less_node)\
+\
+static inline void _name(struct dlist *list){\
+    if(list->next == list)\
+        return;\
+    list->prev->next = NULL;\
+    _dlist_sort_relink(list, _name##_sort_chain(list->next));\
+}\
+\
+static inline void _name##_merge(struct dlist *dst, struct dlist *src){\
+    struct dlist *a = NULL, *b = NULL;\
+    if(src->next == src)\
+        return;\
+    if(dst->next != dst){\
+        dst->prev->next = NULL;\
+        a = dst->next;\
+    }\
+    src->prev->next = NULL;\
+    b = src->next;\
+    dlist_init(src);\
+    _dlist_sort_relink(dst, _name##_merge_chain(a, b));\
+}
+
+/*
+ * Defines the merge sort _name and the merge _name##_merge for an MDLIST(_type, _field).
+ *
+ * The head of an MDLIST is a smaller struct than _type, so next and prev of
+ * the head and of the nodes are only accessed through _type ** pointers and
+ * never through a _type lvalue, which the compiler would assume cannot refer
+ * to the head.
+ */
+#define MDLIST_SORT_DEFINE(_name, _type, _field, _less)\
+\
+static inline _type **_name##_next_p(void *node){\
+    return (_type **)((uint8_t *)node + offsetof(_type, _field.next));\
+}\
+\
+static inline _type **_name##_prev_p(void *node){\
+    return (_type **)((uint8_t *)node + offsetof(_type, _field.prev));\
+}\
+\
+_DLIST_SORT_CHAIN_DEFINE(_name, _type, *_name##_next_p, _less)\
+\
+static inline void _name##_relink(void *list, _type *first){\
+    _type *prev = (_type *)list;\
+    for(; first != NULL; first = *_name##_next_p(first)){\
+        *_name##_next_p(prev) = first;\
+        *_name##_prev_p(first) = prev;\
+        prev = first;\
+    }\
+    *_name##_next_p(prev) = (_type *)list;\
+    *_name##_prev_p(list) = prev;\
+}\
+\
+static inline void _name(void *list){\
+    if(*_name##_next_p(list) == (_type *)list)\
+        return;\
+    *_name##_next_p(*_name##_prev_p(list)) = NULL;\
+    _name##_relink(list, _name##_sort_chain(*_name##_next_p(list)));\
+}\
+\
+static inline void _name##_merge(void *dst, void *src){\
+    _type *a = NULL, *b;\
+    if(*_name##_next_p(src) == (_type *)src)\
+        return;\
+    if(*_name##_next_p(dst) != (_type *)dst){\
+        *_name##_next_p(*_name##_prev_p(dst)) = NULL;\
+        a = *_name##_next_p(dst);\
+    }\
+    *_name##_next_p(*_name##_prev_p(src)) = NULL;\
+    b = *_name##_next_p(src);\
+    *_name##_next_p(src) = *_name##_prev_p(src) = (_type *)src;\
+    _name##_relink(dst, _name##_merge_chain(a, b));\
+}
+
+#endif //DLIST_SORT_H
@@ -22,6 +22,8 @@
 
 #include <stddef.h>
 #include <stdint.h>
+#include <string.h>
+#include <stdatomic.h>
 
 typedef unsigned int uint;
 /*
@@ -34,67 +36,352 @@ typedef unsigned int uint;
  * |00000##########00000|
  * ----------------------
  *       |<-data->|
+ *
+ * If mirror is set, data is followed by a second mapping of the same memory
+ * (see fifo_mirror.h), so every region of the ring is contiguous.
  */
 struct fifo {
     size_t size, tail, head;
     uint8_t *data;
+    int mirror;
+};
+
+/*
+ * If FIFO_POW2 is defined every fifo has to be initialized with a size that is
+ * a power of two. Indices are then wrapped with a mask instead of a compare.
+ * fifo_init and fifo_spsc_init return NULL for other sizes.
+ *
+ * #define FIFO_POW2
+ */
+
+/*
+ * Size of a cache line. Used to keep the indices of struct fifo_spsc that are
+ * written by different threads apart from each other.
+ */
+#ifndef FIFO_CACHELINE
+#define FIFO_CACHELINE 64
+#endif
+
+/*
+ * struct fifo_spsc is a lock-free variant of struct fifo for exactly one
+ * producer and one consumer thread.
+ *
+ * head is only written by the producer and tail only by the consumer. Each of
+ * them lives on its own cache line together with a cached copy of the
+ * opposite index. The cached copy is only refreshed (with an acquire load)
+ * when it does not satisfy the current request, so in the common case
+ * neither thread touches the cache line of the other one.
+ */
+struct fifo_spsc {
+    size_t size;
+    uint8_t *data;
+    int mirror;
+    _Alignas(FIFO_CACHELINE) _Atomic(size_t) head;
+    size_t tail_cache;
+    _Alignas(FIFO_CACHELINE) _Atomic(size_t) tail;
+    size_t head_cache;
+};
+
+/*
+ * A contiguous region inside the ring of a fifo. Reserved or readable regions
+ * are returned as up to two spans, the second one starting at the beginning
+ * of the ring if the region wraps around (its size is 0 otherwise).
+ */
+struct fifo_span {
+    uint8_t *data;
+    size_t size;
 };
 
 static inline struct fifo *fifo_init(struct fifo *self, void *data, size_t size);
 static inline struct fifo *fifo_copy(struct fifo *dst, const struct fifo *src);
 static inline size_t fifo_size(const struct fifo *self);
-static inline int fifo_write(struct fifo *self, void *src, size_t size);
+static inline int fifo_write(struct fifo *self, const void *src, size_t size);
 static inline int fifo_read(struct fifo *self, void *dst, size_t size);
 static inline int fifo_peek(const struct fifo *self, void *dst, size_t size);
+static inline size_t fifo_reserve(struct fifo *self, struct fifo_span span[2]);
+static inline int fifo_commit(struct fifo *self, size_t size);
+static inline size_t fifo_peek_span(const struct fifo *self, struct fifo_span span[2]);
+static inline int fifo_consume(struct fifo *self, size_t size);
+
+/*
+ * Internal function wrapping an index that is smaller than 2 * size.
+ */
+static inline size_t _fifo_wrap(size_t size, size_t index){
+#ifdef FIFO_POW2
+    return index & (size - 1);
+#else
+    return index >= size ? index - size : index;
+#endif
+}
+
+/*
+ * Internal function returning the number of bytes between tail and head.
+ */
+static inline size_t _fifo_used(size_t size, size_t head, size_t tail){
+#ifdef FIFO_POW2
+    return (head - tail) & (size - 1);
+#else
+    if (head >= tail)
+        return head - tail;
+    else
+        return size + head - tail;
+#endif
+}
+
+/*
+ * Internal function copying size bytes from src into the ring at index.
+ * The copy is split into at most two memcpy calls at the end of the ring.
+ */
+static inline void _fifo_copy_in(uint8_t *data, size_t data_size, size_t index, const void *src, size_t size){
+    size_t first = data_size - index;
+    if (first > size)
+        first = size;
+    memcpy(data + index, src, first);
+    memcpy(data, (const uint8_t *)src + first, size - first);
+}
+
+/*
+ * Internal function copying size bytes from the ring at index into dst.
+ */
+static inline void _fifo_copy_out(const uint8_t *data, size_t data_size, size_t index, void *dst, size_t size){
+    size_t first = data_size - index;
+    if (first > size)
+        first = size;
+    memcpy(dst, data + index, first);
+    memcpy((uint8_t *)dst + first, data, size - first);
+}
+
+/*
+ * Internal function splitting the size bytes starting at index into two spans.
+ * A mirrored ring is never split.
+ *
+ * @return size
+ */
+static inline size_t _fifo_span(uint8_t *data, size_t data_size, int mirror, size_t index, size_t size, struct fifo_span span[2]){
+    size_t first = data_size - index;
+    if (mirror || first > size)
+        first = size;
+    span[0].data = data + index;
+    span[0].size = first;
+    span[1].data = data;
+    span[1].size = size - first;
+    return size;
+}
 
 static inline struct fifo *fifo_init(struct fifo *self, void *data, size_t size) {
+#ifdef FIFO_POW2
+    if (size == 0 || (size & (size - 1)) != 0)
+        return NULL;
+#endif
     self->size = size;
     self->data = data;
+    self->mirror = 0;
     self->tail = 0;
     self->head = 0;
     return self;
 };
 
 static inline struct fifo *fifo_copy(struct fifo *dst, const struct fifo *src){
-    if(dst->size >= src->size){
-        fifo_peek(src, dst->data, src->size);
-        dst->head = src->size;
+    size_t size = fifo_size(src);
+    if(dst->size > size){
+        fifo_peek(src, dst->data, size);
+        dst->tail = 0;
+        dst->head = size;
         return dst;
     }
     return NULL;
 }
 
 static inline size_t fifo_size(const struct fifo *self){
-    if (self->head >= self->tail)
-        return self->head - self->tail;
-    else
-        return self->size + self->head - self->tail;
+    return _fifo_used(self->size, self->head, self->tail);
 }
 
-static inline int fifo_write(struct fifo *self, void *src, size_t size) {
-    if (fifo_size(self) + size >= self->size)
+static inline int fifo_write(struct fifo *self, const void *src, size_t size) {
+    if (size >= self->size - fifo_size(self))
         return 0;
-    for (uint i = 0; i < size; i++) {
-        self->data[(self->head + i) % self->size] = ((uint8_t *)src)[i];
-    }
-    self->head = (self->head + size) % self->size;
+    _fifo_copy_in(self->data, self->size, self->head, src, size);
+    self->head = _fifo_wrap(self->size, self->head + size);
     return 1;
 }
 
 static inline int fifo_read(struct fifo *self, void *dst, size_t size) {
     if (fifo_size(self) < size)
         return 0;
-    for (uint i = 0; i < size; i++)
-        ((uint8_t *)dst)[i] = self->data[(self->tail + i) % self->size];
-    self->tail = (self->tail + size) % self->size;
+    _fifo_copy_out(self->data, self->size, self->tail, dst, size);
+    self->tail = _fifo_wrap(self->size, self->tail + size);
     return 1;
 }
 
 static inline int fifo_peek(const struct fifo *self, void *dst, size_t size){
     if(fifo_size(self) < size)
         return 0;
-    for (uint i = 0; i < size; i++)
-        ((uint8_t *)dst)[i] = self->data[(self->tail + 1) % self->size];
+    _fifo_copy_out(self->data, self->size, self->tail, dst, size);
+    return 1;
+}
+
+/*
+ * fifo_reserve returns the free space of the fifo as spans into the ring, so
+ * that it can be filled in place (e.g. by read(2)). Nothing becomes readable
+ * until fifo_commit is called.
+ *
+ * @param self: pointer to the fifo
+ * @param span: array of two spans that is filled with the free region
+ * @return number of free bytes (span[0].size + span[1].size)
+ */
+static inline size_t fifo_reserve(struct fifo *self, struct fifo_span span[2]){
+    return _fifo_span(self->data, self->size, self->mirror, self->head, self->size - 1 - fifo_size(self), span);
+}
+
+/*
+ * fifo_commit makes size bytes of the region returned by fifo_reserve readable.
+ *
+ * @return 1 if success, 0 if size exceeds the free space
+ */
+static inline int fifo_commit(struct fifo *self, size_t size){
+    if (size >= self->size - fifo_size(self))
+        return 0;
+    self->head = _fifo_wrap(self->size, self->head + size);
+    return 1;
+}
+
+/*
+ * fifo_peek_span returns the content of the fifo as spans into the ring, so
+ * that it can be parsed in place.
+ *
+ * @param self: pointer to the fifo
+ * @param span: array of two spans that is filled with the readable region
+ * @return number of readable bytes (span[0].size + span[1].size)
+ */
+static inline size_t fifo_peek_span(const struct fifo *self, struct fifo_span span[2]){
+    return _fifo_span(self->data, self->size, self->mirror, self->tail, fifo_size(self), span);
+}
+
+/*
+ * fifo_consume drops size bytes from the front of the fifo without copying them.
+ *
+ * @return 1 if success, 0 if there were less than size bytes in the fifo
+ */
+static inline int fifo_consume(struct fifo *self, size_t size){
+    if (fifo_size(self) < size)
+        return 0;
+    self->tail = _fifo_wrap(self->size, self->tail + size);
+    return 1;
+}
+
+/*
+ * Initializes a struct fifo_spsc. Has to be called before any thread uses it.
+ *
+ * @param self: pointer to the fifo
+ * @param data: buffer of size bytes used as ring (size - 1 bytes are usable)
+ * @param size: size of data in bytes
+ * @return self
+ */
+static inline struct fifo_spsc *fifo_spsc_init(struct fifo_spsc *self, void *data, size_t size){
+#ifdef FIFO_POW2
+    if (size == 0 || (size & (size - 1)) != 0)
+        return NULL;
+#endif
+    self->size = size;
+    self->data = data;
+    self->mirror = 0;
+    atomic_init(&self->head, 0);
+    atomic_init(&self->tail, 0);
+    self->tail_cache = 0;
+    self->head_cache = 0;
+    return self;
+}
+
+/*
+ * Returns the number of bytes in the fifo.
+ * The result is only a snapshot if called while the other thread is active.
+ */
+static inline size_t fifo_spsc_size(struct fifo_spsc *self){
+    size_t head = atomic_load_explicit(&self->head, memory_order_acquire);
+    size_t tail = atomic_load_explicit(&self->tail, memory_order_acquire);
+    return _fifo_used(self->size, head, tail);
+}
+
+/*
+ * Writes size bytes from src into the fifo. May only be called by the producer.
+ *
+ * @return 1 if success, 0 if there was not enough space
+ */
+static inline int fifo_spsc_write(struct fifo_spsc *self, const void *src, size_t size){
+    size_t head = atomic_load_explicit(&self->head, memory_order_relaxed);
+    size_t tail = self->tail_cache;
+    if (size >= self->size - _fifo_used(self->size, head, tail)){
+        tail = self->tail_cache = atomic_load_explicit(&self->tail, memory_order_acquire);
+        if (size >= self->size - _fifo_used(self->size, head, tail))
+            return 0;
+    }
+    _fifo_copy_in(self->data, self->size, head, src, size);
+    atomic_store_explicit(&self->head, _fifo_wrap(self->size, head + size), memory_order_release);
+    return 1;
+}
+
+/*
+ * Reads size bytes from the fifo into dst. May only be called by the consumer.
+ *
+ * @return 1 if success, 0 if there were less than size bytes in the fifo
+ */
+static inline int fifo_spsc_read(struct fifo_spsc *self, void *dst, size_t size){
+    size_t tail = atomic_load_explicit(&self->tail, memory_order_relaxed);
+    size_t head = self->head_cache;
+    if (_fifo_used(self->size, head, tail) < size){
+        head = self->head_cache = atomic_load_explicit(&self->head, memory_order_acquire);
+        if (_fifo_used(self->size, head, tail) < size)
+            return 0;
+    }
+    _fifo_copy_out(self->data, self->size, tail, dst, size);
+    atomic_store_explicit(&self->tail, _fifo_wrap(self->size, tail + size), memory_order_release);
+    return 1;
+}
+
+/*
+ * Same as fifo_reserve for the producer of a struct fifo_spsc.
+ * The free space is computed from a fresh copy of tail.
+ */
+static inline size_t fifo_spsc_reserve(struct fifo_spsc *self, struct fifo_span span[2]){
+    size_t head = atomic_load_explicit(&self->head, memory_order_relaxed);
+    size_t tail = self->tail_cache = atomic_load_explicit(&self->tail, memory_order_acquire);
+    return _fifo_span(self->data, self->size, self->mirror, head, self->size - 1 - _fifo_used(self->size, head, tail), span);
+}
+
+/*
+ * Same as fifo_commit for the producer of a struct fifo_spsc.
+ */
+static inline int fifo_spsc_commit(struct fifo_spsc *self, size_t size){
+    size_t head = atomic_load_explicit(&self->head, memory_order_relaxed);
+    if (size >= self->size - _fifo_used(self->size, head, self->tail_cache)){
+        self->tail_cache = atomic_load_explicit(&self->tail, memory_order_acquire);
+        if (size >= self->size - _fifo_used(self->size, head, self->tail_cache))
+            return 0;
+    }
+    atomic_store_explicit(&self->head, _fifo_wrap(self->size, head + size), memory_order_release);
+    return 1;
+}
+
+/*
+ * Same as fifo_peek_span for the consumer of a struct fifo_spsc.
+ * The readable region is computed from a fresh copy of head.
+ */
+static inline size_t fifo_spsc_peek_span(struct fifo_spsc *self, struct fifo_span span[2]){
+    size_t tail = atomic_load_explicit(&self->tail, memory_order_relaxed);
+    size_t head = self->head_cache = atomic_load_explicit(&self->head, memory_order_acquire);
+    return _fifo_span(self->data, self->size, self->mirror, tail, _fifo_used(self->size, head, tail), span);
+}
+
+/*
+ * Same as fifo_consume for the consumer of a struct fifo_spsc.
+ */
+static inline int fifo_spsc_consume(struct fifo_spsc *self, size_t size){
+    size_t tail = atomic_load_explicit(&self->tail, memory_order_relaxed);
+    if (_fifo_used(self->size, self->head_cache, tail) < size){
+        self->head_cache = atomic_load_explicit(&self->head, memory_order_acquire);
+        if (_fifo_used(self->size, self->head_cache, tail) < size)
+            return 0;
+    }
+    atomic_store_explicit(&self->tail, _fifo_wrap(self->size, tail + size), memory_order_release);
     return 1;
 }
 
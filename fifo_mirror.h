@@ -0,0 +1,174 @@
+/*
+   Copyright (c) 2021 Christian Döring
+   Permission is hereby granted, free of charge, to any person obtaining a copy
+   of this software and associated documentation files (the "Software"), to deal
+   in the Software without restriction, including without limitation the rights
+   to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+   copies of the Software, and to permit persons to whom the Software is
+   furnished to do so, subject to the following conditions:
+   The above copyright notice and this permission notice shall be included in all
+   copies or substantial portions of the Software.
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+   IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+   FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+   AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+   LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+   OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+   SOFTWARE.
+   */
+
+#ifndef FIFO_MIRROR_H
+#define FIFO_MIRROR_H
+
+/*
+ * memfd_create needs _GNU_SOURCE. It only takes effect if it is defined
+ * before the first system header, so it has to be defined by the caller,
+ * best on the command line (-D_GNU_SOURCE).
+ */
+#ifndef _GNU_SOURCE
+#error "fifo_mirror.h needs _GNU_SOURCE defined before any header is included"
+#endif
+
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include "fifo.h"
+
+/*
+ * Mirrored backend for struct fifo and struct fifo_spsc (Linux only).
+ *
+ * The ring is a memfd that is mapped twice back to back:
+ *
+ *    data               data + size
+ *     |                  |
+ *     V                  V
+ * -----------------------------------------
+ * |###00000000000######|###00000000000######|
+ * -----------------------------------------
+ *  |<-   mapping 1  ->| |<-   mapping 2  ->|
+ *
+ * Writing to data[size + i] writes data[i], so a region that wraps around the
+ * end of the ring can be accessed as one contiguous block. fifo_reserve and
+ * fifo_peek_span then always return a single span (span[1].size == 0).
+ *
+ * If the mapping can not be created the fifo falls back to a plain malloc'ed
+ * ring and behaves exactly like a fifo created with fifo_init.
+ *
+ * Usage example:
+ *
+ *   struct fifo f;
+ *   struct fifo_span span[2];
+ *
+ *   fifo_mirror_init(&f, 1 << 16);
+ *
+ *   fifo_reserve(&f, span);
+ *   ssize_t n = read(fd, span[0].data, span[0].size);
+ *   if(n > 0)
+ *       fifo_commit(&f, n);
+ *
+ *   fifo_mirror_free(&f);
+ */
+
+/*
+ * Internal function allocating the ring.
+ * size is rounded up to a multiple of the page size, with FIFO_POW2 to a
+ * power of two (which is a multiple of the page size as well).
+ *
+ * @param size: pointer to the requested size, set to the allocated size
+ * @param mirror: set to 1 if the ring is mirrored, 0 if it is malloc'ed
+ * @return pointer to the ring, NULL if failed
+ */
+static inline uint8_t *_fifo_mirror_alloc(size_t *size, int *mirror){
+    size_t page = (size_t)sysconf(_SC_PAGESIZE);
+    if(*size > SIZE_MAX / 2 - page)
+        return NULL;
+    *size = *size > page ? (*size + page - 1) / page * page : page;
+#ifdef FIFO_POW2
+    *size = (size_t)1 << (sizeof(unsigned long long) * 8 - __builtin_clzll((unsigned long long)(*size - 1)));
+#endif
+    *mirror = 0;
+
+    int fd = memfd_create("fifo", MFD_CLOEXEC);
+    if(fd >= 0){
+        uint8_t *data = NULL;
+        if(ftruncate(fd, (off_t)*size) == 0)
+            data = mmap(NULL, 2 * *size, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if(data != NULL && data != MAP_FAILED){
+            if(mmap(data, *size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED, fd, 0) != MAP_FAILED &&
+                    mmap(data + *size, *size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED, fd, 0) != MAP_FAILED){
+                close(fd);
+                *mirror = 1;
+                return data;
+            }
+            munmap(data, 2 * *size);
+        }
+        close(fd);
+    }
+    return malloc(*size);
+}
+
+/*
+ * Internal function freeing a ring allocated by _fifo_mirror_alloc.
+ */
+static inline void _fifo_mirror_free(uint8_t *data, size_t size, int mirror){
+    if(mirror)
+        munmap(data, 2 * size);
+    else
+        free(data);
+}
+
+/*
+ * Allocates a mirrored ring of at least size bytes and initializes the fifo
+ * with it (see fifo_init).
+ *
+ * @param self: pointer to the fifo
+ * @param size: minimum size of the ring, rounded up to the page size
+ *              (with FIFO_POW2 to a power of two)
+ * @return self, NULL if failed
+ */
+static inline struct fifo *fifo_mirror_init(struct fifo *self, size_t size){
+    int mirror;
+    uint8_t *data;
+    if((data = _fifo_mirror_alloc(&size, &mirror)) == NULL)
+        return NULL;
+    if(fifo_init(self, data, size) == NULL){
+        _fifo_mirror_free(data, size, mirror);
+        return NULL;
+    }
+    self->mirror = mirror;
+    return self;
+}
+
+/*
+ * Frees the ring of a fifo initialized with fifo_mirror_init.
+ */
+static inline void fifo_mirror_free(struct fifo *self){
+    _fifo_mirror_free(self->data, self->size, self->mirror);
+    self->data = NULL;
+}
+
+/*
+ * Same as fifo_mirror_init for struct fifo_spsc.
+ */
+static inline struct fifo_spsc *fifo_spsc_mirror_init(struct fifo_spsc *self, size_t size){
+    int mirror;
+    uint8_t *data;
+    if((data = _fifo_mirror_alloc(&size, &mirror)) == NULL)
+        return NULL;
+    if(fifo_spsc_init(self, data, size) == NULL){
+        _fifo_mirror_free(data, size, mirror);
+        return NULL;
+    }
+    self->mirror = mirror;
+    return self;
+}
+
+/*
+ * Frees the ring of a fifo initialized with fifo_spsc_mirror_init.
+ */
+static inline void fifo_spsc_mirror_free(struct fifo_spsc *self){
+    _fifo_mirror_free(self->data, self->size, self->mirror);
+    self->data = NULL;
+}
+
+#endif //FIFO_MIRROR_H
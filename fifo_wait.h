@@ -0,0 +1,243 @@
+/*
+   Copyright (c) 2021 Christian Döring
+   Permission is hereby granted, free of charge, to any person obtaining a copy
+   of this software and associated documentation files (the "Software"), to deal
+   in the Software without restriction, including without limitation the rights
+   to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+   copies of the Software, and to permit persons to whom the Software is
+   furnished to do so, subject to the following conditions:
+   The above copyright notice and this permission notice shall be included in all
+   copies or substantial portions of the Software.
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+   IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+   FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+   AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+   LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+   OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+   SOFTWARE.
+   */
+
+#ifndef FIFO_WAIT_H
+#define FIFO_WAIT_H
+
+/*
+ * syscall needs _GNU_SOURCE. It only takes effect if it is defined before the
+ * first system header, so it has to be defined by the caller, best on the
+ * command line (-D_GNU_SOURCE).
+ */
+#ifndef _GNU_SOURCE
+#error "fifo_wait.h needs _GNU_SOURCE defined before any header is included"
+#endif
+
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+#include "fifo.h"
+
+/*
+ * struct fifo_wait adds blocking reads and writes to a struct fifo_spsc
+ * (Linux only).
+ *
+ * A thread that has to wait publishes how many bytes it needs in read_want
+ * or write_want and sleeps on the futex read_seq or write_seq. The other
+ * thread checks the want field after every write or read and only issues
+ * the wake syscall if somebody sleeps and the requested amount is
+ * available. As long as nobody waits, the cost on top of struct fifo_spsc
+ * is a fence and one load per operation.
+ *
+ * Timeouts are given in milliseconds. A negative timeout waits forever and
+ * a timeout of 0 does not wait at all.
+ *
+ * Usage example (consumer processing in batches of at least 4 KiB):
+ *
+ *   struct fifo_span span[2];
+ *   size_t n;
+ *   while((n = fifo_wait_readable(&f, 4096, 100)) != 0){
+ *       fifo_spsc_peek_span(&f.fifo, span);
+ *       ...
+ *       fifo_wait_consume(&f, n);
+ *   }
+ */
+struct fifo_wait {
+    struct fifo_spsc fifo;
+    _Alignas(FIFO_CACHELINE) _Atomic(uint32_t) read_seq;
+    _Atomic(size_t) read_want;
+    _Alignas(FIFO_CACHELINE) _Atomic(uint32_t) write_seq;
+    _Atomic(size_t) write_want;
+};
+
+/*
+ * Internal function converting a timeout in milliseconds to an absolute
+ * CLOCK_MONOTONIC deadline.
+ */
+static inline void _fifo_wait_deadline(struct timespec *deadline, int timeout){
+    clock_gettime(CLOCK_MONOTONIC, deadline);
+    deadline->tv_sec += timeout / 1000;
+    deadline->tv_nsec += (long)(timeout % 1000) * 1000000;
+    if(deadline->tv_nsec >= 1000000000){
+        deadline->tv_sec += 1;
+        deadline->tv_nsec -= 1000000000;
+    }
+}
+
+/*
+ * Internal function sleeping on futex as long as it equals val.
+ *
+ * @param deadline: absolute CLOCK_MONOTONIC time, NULL to wait forever
+ * @return 0 if the deadline passed, 1 else (woken, spurious or val changed)
+ */
+static inline int _fifo_futex_wait(_Atomic(uint32_t) *futex, uint32_t val, const struct timespec *deadline){
+    if(syscall(SYS_futex, futex, FUTEX_WAIT_BITSET_PRIVATE, val, deadline, NULL, FUTEX_BITSET_MATCH_ANY) != 0 && errno == ETIMEDOUT)
+        return 0;
+    return 1;
+}
+
+/*
+ * Internal function waking the thread sleeping on futex.
+ */
+static inline void _fifo_futex_wake(_Atomic(uint32_t) *futex){
+    atomic_fetch_add_explicit(futex, 1, memory_order_release);
+    syscall(SYS_futex, futex, FUTEX_WAKE_PRIVATE, 1, NULL, NULL, 0);
+}
+
+/*
+ * Internal function returning the number of readable bytes.
+ */
+static inline size_t _fifo_wait_used(struct fifo_wait *self){
+    return fifo_spsc_size(&self->fifo);
+}
+
+/*
+ * Internal function returning the number of free bytes.
+ */
+static inline size_t _fifo_wait_free(struct fifo_wait *self){
+    return self->fifo.size - 1 - fifo_spsc_size(&self->fifo);
+}
+
+/*
+ * Internal function implementing the wait for both sides.
+ *
+ * @param avail: function returning the bytes available to the waiting side
+ * @return number of available bytes, 0 on timeout
+ */
+static inline size_t _fifo_wait(struct fifo_wait *self, _Atomic(uint32_t) *seq, _Atomic(size_t) *want,
+        size_t (*avail)(struct fifo_wait *), size_t min, int timeout){
+    struct timespec deadline;
+    size_t n;
+    if(min == 0)
+        min = 1;
+    if((n = avail(self)) >= min)
+        return n;
+    if(timeout == 0 || min >= self->fifo.size)
+        return 0;
+    if(timeout > 0)
+        _fifo_wait_deadline(&deadline, timeout);
+    for(;;){
+        uint32_t val = atomic_load_explicit(seq, memory_order_acquire);
+        atomic_store_explicit(want, min, memory_order_seq_cst);
+        atomic_thread_fence(memory_order_seq_cst);
+        if((n = avail(self)) >= min)
+            break;
+        if(!_fifo_futex_wait(seq, val, timeout > 0 ? &deadline : NULL)){
+            atomic_store_explicit(want, 0, memory_order_relaxed);
+            n = avail(self);
+            return n >= min ? n : 0;
+        }
+    }
+    atomic_store_explicit(want, 0, memory_order_relaxed);
+    return n;
+}
+
+/*
+ * Internal function waking the other side if it waits for less than avail bytes.
+ */
+static inline void _fifo_wait_notify(struct fifo_wait *self, _Atomic(uint32_t) *seq, _Atomic(size_t) *want,
+        size_t (*avail)(struct fifo_wait *)){
+    atomic_thread_fence(memory_order_seq_cst);
+    size_t n = atomic_load_explicit(want, memory_order_relaxed);
+    if(n != 0 && avail(self) >= n && atomic_compare_exchange_strong(want, &n, 0))
+        _fifo_futex_wake(seq);
+}
+
+/*
+ * Initializes a struct fifo_wait (see fifo_spsc_init).
+ */
+static inline struct fifo_wait *fifo_wait_init(struct fifo_wait *self, void *data, size_t size){
+    if(fifo_spsc_init(&self->fifo, data, size) == NULL)
+        return NULL;
+    atomic_init(&self->read_seq, 0);
+    atomic_init(&self->read_want, 0);
+    atomic_init(&self->write_seq, 0);
+    atomic_init(&self->write_want, 0);
+    return self;
+}
+
+/*
+ * Waits until at least min bytes can be read. May only be called by the consumer.
+ *
+ * @return number of readable bytes (>= min), 0 on timeout
+ */
+static inline size_t fifo_wait_readable(struct fifo_wait *self, size_t min, int timeout){
+    return _fifo_wait(self, &self->read_seq, &self->read_want, _fifo_wait_used, min, timeout);
+}
+
+/*
+ * Waits until at least min bytes can be written. May only be called by the producer.
+ *
+ * @return number of free bytes (>= min), 0 on timeout
+ */
+static inline size_t fifo_wait_writable(struct fifo_wait *self, size_t min, int timeout){
+    return _fifo_wait(self, &self->write_seq, &self->write_want, _fifo_wait_free, min, timeout);
+}
+
+/*
+ * Same as fifo_spsc_commit, wakes the consumer if it waits for the new data.
+ */
+static inline int fifo_wait_commit(struct fifo_wait *self, size_t size){
+    if(!fifo_spsc_commit(&self->fifo, size))
+        return 0;
+    _fifo_wait_notify(self, &self->read_seq, &self->read_want, _fifo_wait_used);
+    return 1;
+}
+
+/*
+ * Same as fifo_spsc_consume, wakes the producer if it waits for the freed space.
+ */
+static inline int fifo_wait_consume(struct fifo_wait *self, size_t size){
+    if(!fifo_spsc_consume(&self->fifo, size))
+        return 0;
+    _fifo_wait_notify(self, &self->write_seq, &self->write_want, _fifo_wait_free);
+    return 1;
+}
+
+/*
+ * Writes size bytes from src, waiting up to timeout ms for enough space.
+ *
+ * @return 1 if success, 0 on timeout
+ */
+static inline int fifo_wait_write(struct fifo_wait *self, const void *src, size_t size, int timeout){
+    if(!fifo_spsc_write(&self->fifo, src, size)){
+        if(fifo_wait_writable(self, size, timeout) == 0 || !fifo_spsc_write(&self->fifo, src, size))
+            return 0;
+    }
+    _fifo_wait_notify(self, &self->read_seq, &self->read_want, _fifo_wait_used);
+    return 1;
+}
+
+/*
+ * Reads size bytes into dst, waiting up to timeout ms for enough data.
+ *
+ * @return 1 if success, 0 on timeout
+ */
+static inline int fifo_wait_read(struct fifo_wait *self, void *dst, size_t size, int timeout){
+    if(!fifo_spsc_read(&self->fifo, dst, size)){
+        if(fifo_wait_readable(self, size, timeout) == 0 || !fifo_spsc_read(&self->fifo, dst, size))
+            return 0;
+    }
+    _fifo_wait_notify(self, &self->write_seq, &self->write_want, _fifo_wait_free);
+    return 1;
+}
+
+#endif //FIFO_WAIT_H
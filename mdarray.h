@@ -25,14 +25,47 @@ SOFTWARE.
 #include <string.h>
 
 /*
+ * Mdarray is the macro based sibling of darray. The macros know the type of
+ * the elements, so elements are passed by value and converted to the element
+ * type like in an assignment.
+ *
  * |------+-----+------|
  * | size | cap | data |
  * |------+-----+------|
  *                  ^
  *                  |
  *              Pointer on whitch macros act upon.
+ *
+ * size and cap are stored in bytes.
+ *
+ * MDARRAY_APPEND only checks the capacity and stores the element. Growing is
+ * done in mdarray_grow, which is kept out of line so the append stays small
+ * enough to be inlined into loops.
+ *
+ * Usage example:
+ *
+ *   MDARRAY(double) test;
+ *   MDARRAY_INIT(test);
+ *
+ *   for(int i = 0; i < 100; i++)
+ *       MDARRAY_APPEND(test, i);
+ *
+ *   MDARRAY_INSERT_VA(test, 2, 1.5, 2.5);
+ *   MDARRAY_REMOVE(test, 0);
+ *
+ *   for(size_t i = 0; i < MDARRAY_SIZE(test); i++)
+ *       printf("%f\n", test[i]);
+ *
+ *   MDARRAY_FREE(test);
  */
 
+#if defined(__GNUC__)
+#define MDARRAY_LIKELY(_x) __builtin_expect(!!(_x), 1)
+#define MDARRAY_SLOW_PATH __attribute__((noinline, cold, unused))
+#else
+#define MDARRAY_LIKELY(_x) (_x)
+#define MDARRAY_SLOW_PATH
+#endif
 
 struct mdarray_header{
     size_t size, cap;
@@ -42,75 +75,44 @@ struct mdarray_header{
 
 #define MDARRAY_HEADER(_arr) ((struct mdarray_header *)(((uint8_t *)(_arr)) - (sizeof(struct mdarray_header))))
 
-#define MDARRAY_INIT(_arr) {struct mdarray_header *header = malloc(sizeof(struct mdarray_header)); header->size = 0; header->cap = 0; _arr = (void*)&header[1];}
+/*
+ * Initializes the mdarray.
+ *
+ * @return pointer to the header (NULL if failed)
+ */
+#define MDARRAY_INIT(_arr) mdarray_init((void **)&(_arr))
 
 #define MDARRAY_SIZE(_arr) (MDARRAY_HEADER(_arr)->size / sizeof(*(_arr)))
 
-#if 0
-#define _MDARRAY_INC(_arr, _delta)\
-    struct mdarray_header *header = MDARRAY_HEADER(_arr);\
-    size_t cap = mdarray_ciellog2(header->size+_delta);\
-    if(cap != header->cap)\
-        header = realloc(header, sizeof(struct mdarray_header)+cap*sizeof(*(_arr)));\
-
-#define MDARRAY_APPEND(_arr, _elem) {\
-    struct mdarray_header *header = MDARRAY_HEADER(_arr);\
-    size_t cap = mdarray_ciellog2(header->size+1);\
-    if(cap != header->cap)\
-        header = realloc(header, sizeof(struct mdarray_header)+cap*sizeof(*(_arr)));\
-    if(header != NULL){\
-        header->cap = cap;\
-        (_arr) = (void *)&header[1];\
-        (_arr)[header->size] = (_elem);\
-        header->size += 1;\
-    }\
-}
+#define MDARRAY_CAP(_arr) (MDARRAY_HEADER(_arr)->cap / sizeof(*(_arr)))
 
-#define MDARRAY_INSERT(_arr, _elem, _index) {\
-    struct mdarray_header *header = MDARRAY_HEADER(_arr);\
-    size_t cap = mdarray_ciellog2(header->size+1);\
-    if(cap != header->cap)\
-        header = realloc(header, sizeof(struct mdarray_header)+cap*sizeof(*(_arr)));\
-    if(header != NULL){\
-        header->cap = cap;\
-        (_arr) = (void *)&header[1];\
-        memmove(&(_arr)[_index+1], &(_arr)[_index], sizeof(*(_arr)) * (header->size - (_index)));\
-        (_arr)[_index] = (_elem);\
-        header->size += 1;\
-    }\
-}
+#define MDARRAY_VA_HEAD(_x, ...) (_x)
 
-#define MDARRAY_INSERT_ARR(_arr, _src, _src_num, _index)\
-    struct mdarray_header *header = MDARRAY_HEADER(_arr);\
-    size_t cap = mdarray_ciellog2(header->size+(_src_num));\
-    if(cap != header->cap)\
-        header = realloc(header, sizeof(struct mdarray_header)+cap*sizeof(*(_arr)));\
-    if(header != NULL){\
-        header->cap = cap;\
-        (_arr) = (void *)&header[1];\
-        memmove(&(_arr)[_index+(_src_num)], &(_arr)[_index], sizeof(*(_arr)) * (header->size - (_index)));\
-        memmove(&(_arr)[_index], (_src), (_src_num) * sizeof(*(_src)));\
-        (_arr)[_index] = (_elem);\
-        header->size += (_num);\
-    }\
-
-#define MDARRAY_REMOVE(_arr, _num, _index) {\
-    struct mdarray_header *header = MDARRAY_HEADER(_arr);\
-    memmove(&(_arr)[(_index)], &(_arr)[(_index) + (_num)], sizeof(*(_arr)) * (header->size - ((_index) + (_num))));\
-    size_t cap = mdarray_ciellog2(header->size-(_num));\
-    if(cap != header->cap)\
-        header = realloc(header, sizeof(struct mdarray_header)+cap*sizeof(*(_arr)));\
-    if(header != NULL){\
-        header->cap = cap;\
-        (_arr) = (void *)&header[1];\
-        header->size -= (_num);\
-    }\
-}
-#endif
+/*
+ * Appends _elem converted to the element type.
+ * _arr is evaluated multiple times, _elem once.
+ *
+ * @return int: 1 if succes, 0 if failed
+ */
+#define MDARRAY_APPEND(_arr, _elem) (\
+    (MDARRAY_LIKELY(MDARRAY_HEADER(_arr)->cap - MDARRAY_HEADER(_arr)->size >= sizeof(*(_arr))) ||\
+     mdarray_grow((void **)&(_arr), sizeof(*(_arr)))) ?\
+    (*(typeof(_arr))((uint8_t *)(_arr) + MDARRAY_HEADER(_arr)->size) = (_elem),\
+     MDARRAY_HEADER(_arr)->size += sizeof(*(_arr)), 1) : 0)
 
-#define MDARRAY_VA_HEAD(_x, ...) (_x)
+/*
+ * Removes the last element. The mdarray does not shrink.
+ *
+ * @return int: 1 if succes, 0 if the mdarray is empty
+ */
+#define MDARRAY_POP(_arr) (MDARRAY_HEADER(_arr)->size >= sizeof(*(_arr)) ? (MDARRAY_HEADER(_arr)->size -= sizeof(*(_arr)), 1) : 0)
 
-#define MDARRAY_APPEND(_arr, _elem_p) mdarray_append((void **)&(_arr), &(_elem_p), sizeof(_elem_p))
+/*
+ * Increases the capacity to at least _cap elements.
+ *
+ * @return int: 1 if succes, 0 if failed
+ */
+#define MDARRAY_RESERVE(_arr, _cap) mdarray_reserve((void **)&(_arr), (_cap) * sizeof(*(_arr)))
 
 #define MDARRAY_INSERT(_arr, _elem_p, _index) mdarray_insert((void **)&(_arr), _elem_p, sizeof(*(_elem_p)), (_index)*(sizeof(*(_arr))))
 
@@ -126,56 +128,96 @@ struct mdarray_header{
 #define MDARRAY_FREE(_arr) mdarray_free((void **)&(_arr))
 
 
-
+/*
+ * Returns the smallest power of two bigger than x.
+ */
 static inline size_t mdarray_ciellog2(size_t x){
-    size_t i; 
-    for(i = 1; i <= x; i*=2);
-    return i;
+    if(x == 0)
+        return 1;
+    return (size_t)1 << (sizeof(unsigned long long) * 8 - __builtin_clzll((unsigned long long)x));
+}
+
+static inline struct mdarray_header *mdarray_init(void **dst){
+    struct mdarray_header *header;
+    if((header = (struct mdarray_header *)malloc(sizeof(struct mdarray_header))) == NULL)
+        return NULL;
+    header->size = 0;
+    header->cap = 0;
+    *dst = (void *)&header[1];
+    return header;
 }
 
-static inline int mdarray_insert(void **dst, void *src, size_t src_size, size_t index){
+static inline int mdarray_reserve(void **dst, size_t cap){
     struct mdarray_header *header = MDARRAY_HEADER(*dst);
-    size_t target_size = src_size;
-    if(index > header->size)
-        target_size = index;
-    size_t cap = mdarray_ciellog2(header->size+src_size);
-    if(cap != header->cap)
-        header = realloc(header, sizeof(struct mdarray_header)+cap);
-    if(header != NULL){
+    if(cap > header->cap){
+        if((header = (struct mdarray_header *)realloc(header, sizeof(struct mdarray_header)+cap)) == NULL)
+            return 0;
         header->cap = cap;
         *dst = (void *)&header[1];
-        memmove(((uint8_t *)*dst)+src_size+index, ((uint8_t *)*dst)+index, header->size-index);
-        memmove(((uint8_t *)*dst)+index, src, src_size);
-        header->size += src_size;
-        return 1;
     }
-    return 0;
+    return 1;
 }
 
-static inline int mdarray_append(void **dst, void *src, size_t src_size){
+/*
+ * Slow path of MDARRAY_APPEND, grows the mdarray so that size more bytes fit.
+ */
+static MDARRAY_SLOW_PATH int mdarray_grow(void **dst, size_t size){
+    return mdarray_reserve(dst, mdarray_ciellog2(MDARRAY_HEADER(*dst)->size+size));
+}
+
+/*
+ * Inserts src_size bytes from src at index.
+ * If index is past the end the gap is set to zero.
+ */
+static inline int mdarray_insert(void **dst, const void *src, size_t src_size, size_t index){
+    struct mdarray_header *header = MDARRAY_HEADER(*dst);
+    size_t target_size = header->size;
+    if(index > header->size)
+        target_size = index;
+    if(target_size+src_size > header->cap){
+        // realloc may free the old block, so src is rebased if it points into it.
+        int inside = (const uint8_t *)src >= (uint8_t *)*dst && (const uint8_t *)src < (uint8_t *)*dst + header->size;
+        size_t offset = (const uint8_t *)src - (uint8_t *)*dst;
+        if(!mdarray_reserve(dst, mdarray_ciellog2(target_size+src_size)))
+            return 0;
+        if(inside)
+            src = (uint8_t *)*dst + offset;
+        header = MDARRAY_HEADER(*dst);
+    }
+    memset(((uint8_t *)*dst)+header->size, 0, target_size-header->size);
+    memmove(((uint8_t *)*dst)+src_size+index, ((uint8_t *)*dst)+index, target_size-index);
+    memmove(((uint8_t *)*dst)+index, src, src_size);
+    header->size = target_size+src_size;
+    return 1;
+}
+
+static inline int mdarray_append(void **dst, const void *src, size_t src_size){
     return mdarray_insert(dst, src, src_size, MDARRAY_HEADER(*dst)->size);
 }
 
+/*
+ * Removes size bytes at index.
+ * The mdarray shrinks when less than a quarter of the capacity is used.
+ * Shrinking can not fail since the old block stays valid if realloc fails.
+ */
 static inline int mdarray_remove(void **dst, size_t size, size_t index){
     struct mdarray_header *header = MDARRAY_HEADER(*dst);
-    if(index+size >= header->size)
+    if(index+size > header->size)
         return 0;
-    memmove(((uint8_t *)*dst)+index, ((uint8_t *)*dst)+index+size, header->size-index);
+    memmove(((uint8_t *)*dst)+index, ((uint8_t *)*dst)+index+size, header->size-(index+size));
     header->size -= size;
-    size_t cap = mdarray_ciellog2(header->size-size);
-    if(cap != header->cap)
-        header = realloc(header, sizeof(struct mdarray_header)+cap);
-    if(header != NULL){
+    size_t cap = mdarray_ciellog2(header->size);
+    if(cap < header->cap / 2){
+        if((header = (struct mdarray_header *)realloc(header, sizeof(struct mdarray_header)+cap)) == NULL)
+            return 1;
         header->cap = cap;
         *dst = (void *)&header[1];
-        return 1;
     }
     return 1;
 }
 
-void mdarray_free(void **dst){
-    struct mdarray_header *header = MDARRAY_HEADER(*dst);
-    free(header);
+static inline void mdarray_free(void **dst){
+    free(MDARRAY_HEADER(*dst));
     *dst = NULL;
 }
 
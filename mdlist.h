@@ -162,6 +162,44 @@ SOFTWARE.
 #define MDLIST_FOREACH_REV(_type, _iter, _list_p, _field)\
     for(_type (_iter) = (_list_p)->_field.prev; (_iter) != (void *)(_list_p); (_iter) = (_iter)->_field.prev)
 
+/*
+ * Number of nodes MDLIST_FOREACH_PREFETCH runs ahead of the current node
+ */
+#ifndef MDLIST_PREFETCH_DISTANCE
+#define MDLIST_PREFETCH_DISTANCE 4
+#endif
+
+/*
+ * Iterates over the list in a forward direction like MDLIST_FOREACH, while
+ * a second pointer walks MDLIST_PREFETCH_DISTANCE nodes ahead and prefetches
+ * the nodes it reaches. The body must not remove nodes from the list.
+ * It only helps bodies that take about as long as a cache miss (see
+ * dlist_foreach_prefetch in dlist.h).
+ *
+ * @param _type type of the iteratior pointer
+ * @param _iter name of the iterator pointer
+ * @param _list_p pointer to the list
+ * @param _field name of the ENTRY
+ */
+#define MDLIST_FOREACH_PREFETCH(_type, _iter, _list_p, _field)\
+    for(void *_mdlist_ahead = _mdlist_prefetch_ahead((_list_p)->_field.next, (_list_p), MDLIST_PREFETCH_DISTANCE);\
+        _mdlist_ahead != NULL; _mdlist_ahead = NULL)\
+        for(_type (_iter) = (_list_p)->_field.next; (_iter) != (void *)(_list_p);\
+            (_iter) = (_iter)->_field.next, _mdlist_ahead = _mdlist_prefetch_ahead(_mdlist_ahead, (_list_p), 1))
+
+/*
+ * Internal function advancing node by up to distance nodes, without passing
+ * the head list, and prefetching every node it reaches. The ENTRY is the first
+ * member of the nodes and of the head, so next is the first pointer of both.
+ */
+static inline void *_mdlist_prefetch_ahead(void *node, const void *list, unsigned distance){
+    for(; distance > 0 && node != list; distance--){
+        node = *(void **)node;
+        __builtin_prefetch(node);
+    }
+    return node;
+}
+
 #define MDLIST_EMPTY(_list_p, _field) ((_list_p)->_field.next == (void *)(_list_p))
 
 
@@ -0,0 +1,186 @@
+/*
+   Copyright (c) 2021 Christian Döring
+   Permission is hereby granted, free of charge, to any person obtaining a copy
+   of this software and associated documentation files (the "Software"), to deal
+   in the Software without restriction, including without limitation the rights
+   to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+   copies of the Software, and to permit persons to whom the Software is
+   furnished to do so, subject to the following conditions:
+   The above copyright notice and this permission notice shall be included in all
+   copies or substantial portions of the Software.
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+   IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+   FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+   AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+   LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+   OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+   SOFTWARE.
+   */
+
+#ifndef MPMC_H
+#define MPMC_H
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <assert.h>
+#include <stdatomic.h>
+#include "fifo.h"
+
+/*
+ * struct mpmc is a bounded lock-free queue of fixed size elements for any
+ * number of producer and consumer threads.
+ *
+ * Every slot carries a sequence number next to the element:
+ *
+ * +-----+------+-----+------+-----+------+
+ * | seq | elem | seq | elem | seq | elem | ...
+ * +-----+------+-----+------+-----+------+
+ *
+ * A slot at position pos is free for the producer that claimed pos if
+ * seq == pos and holds an element for the consumer that claimed pos if
+ * seq == pos + 1. After consuming, seq is set to pos + cap, which is the
+ * position the slot has in the next round. Producers and consumers only
+ * contend on their own position counter, each of them on its own cache line.
+ *
+ * Usage example:
+ *
+ *   struct mpmc q;
+ *   mpmc_init(&q, int, 1024);
+ *
+ *   int i = 1;
+ *   mpmc_push(&q, &i);
+ *   mpmc_pop(&q, &i);
+ *
+ *   mpmc_free(&q);
+ */
+struct mpmc {
+    uint8_t *slots;
+    size_t mask, stride, offset, elem_size;
+    _Alignas(FIFO_CACHELINE) _Atomic(size_t) enqueue_pos;
+    _Alignas(FIFO_CACHELINE) _Atomic(size_t) dequeue_pos;
+};
+
+/*
+ * Initializes the queue for elements of _type.
+ *
+ * @param _self: pointer to the queue
+ * @param _type: type of the elements
+ * @param _cap: capacity, rounded up to a power of two of at least 2
+ *
+ * @return pointer to the queue (NULL if failed)
+ */
+#define mpmc_init(_self, _type, _cap) _mpmc_init(_self, sizeof(_type), _Alignof(_type), _cap)
+
+/*
+ * Pushes a copy of *_elem_p to the back of the queue.
+ * Asserts that *_elem_p has the size of the elements the queue was initialized for.
+ *
+ * @return int: 1 if succes, 0 if the queue was full
+ */
+#define mpmc_push(_self, _elem_p) (assert(sizeof(*(_elem_p)) == (_self)->elem_size), _mpmc_push(_self, _elem_p))
+
+/*
+ * Pops the front of the queue into *_elem_p.
+ * Asserts that *_elem_p has the size of the elements the queue was initialized for.
+ *
+ * @return int: 1 if succes, 0 if the queue was empty
+ */
+#define mpmc_pop(_self, _elem_p) (assert(sizeof(*(_elem_p)) == (_self)->elem_size), _mpmc_pop(_self, _elem_p))
+
+/*
+ * Internal macro to get the sequence number of the slot at pos.
+ */
+#define MPMC_SEQ(_self, _pos) ((_Atomic(size_t) *)((_self)->slots + ((_pos) & (_self)->mask) * (_self)->stride))
+
+static inline struct mpmc *_mpmc_init(struct mpmc *self, size_t elem_size, size_t elem_align, size_t cap){
+    size_t align = elem_align > _Alignof(_Atomic(size_t)) ? elem_align : _Alignof(_Atomic(size_t));
+    self->elem_size = elem_size;
+    self->offset = (sizeof(_Atomic(size_t)) + elem_align - 1) / elem_align * elem_align;
+    self->stride = (self->offset + elem_size + align - 1) / align * align;
+
+    // The sequence numbers of a single slot cannot tell a full from an empty
+    // queue, so the ring has at least two slots.
+    if(cap < 2)
+        cap = 2;
+    if(cap - 1 > SIZE_MAX >> 1)
+        return NULL;
+    size_t n = (size_t)1 << (sizeof(unsigned long long) * 8 - __builtin_clzll((unsigned long long)(cap - 1)));
+    if(n > SIZE_MAX / self->stride)
+        return NULL;
+    self->mask = n - 1;
+    if((self->slots = (uint8_t *)malloc(n * self->stride)) == NULL)
+        return NULL;
+    for(size_t i = 0; i < n; i++)
+        atomic_init(MPMC_SEQ(self, i), i);
+    atomic_init(&self->enqueue_pos, 0);
+    atomic_init(&self->dequeue_pos, 0);
+    return self;
+}
+
+/*
+ * Internal function pushing a copy of the element at elem to the back of the queue.
+ */
+static inline int _mpmc_push(struct mpmc *self, const void *elem){
+    size_t pos = atomic_load_explicit(&self->enqueue_pos, memory_order_relaxed);
+    _Atomic(size_t) *seq;
+    for(;;){
+        seq = MPMC_SEQ(self, pos);
+        intptr_t dif = (intptr_t)atomic_load_explicit(seq, memory_order_acquire) - (intptr_t)pos;
+        if(dif == 0){
+            if(atomic_compare_exchange_weak_explicit(&self->enqueue_pos, &pos, pos + 1, memory_order_relaxed, memory_order_relaxed))
+                break;
+        }
+        else if(dif < 0)
+            return 0;
+        else
+            pos = atomic_load_explicit(&self->enqueue_pos, memory_order_relaxed);
+    }
+    memcpy((uint8_t *)seq + self->offset, elem, self->elem_size);
+    atomic_store_explicit(seq, pos + 1, memory_order_release);
+    return 1;
+}
+
+/*
+ * Internal function popping the front of the queue into elem.
+ */
+static inline int _mpmc_pop(struct mpmc *self, void *elem){
+    size_t pos = atomic_load_explicit(&self->dequeue_pos, memory_order_relaxed);
+    _Atomic(size_t) *seq;
+    for(;;){
+        seq = MPMC_SEQ(self, pos);
+        intptr_t dif = (intptr_t)atomic_load_explicit(seq, memory_order_acquire) - (intptr_t)(pos + 1);
+        if(dif == 0){
+            if(atomic_compare_exchange_weak_explicit(&self->dequeue_pos, &pos, pos + 1, memory_order_relaxed, memory_order_relaxed))
+                break;
+        }
+        else if(dif < 0)
+            return 0;
+        else
+            pos = atomic_load_explicit(&self->dequeue_pos, memory_order_relaxed);
+    }
+    memcpy(elem, (uint8_t *)seq + self->offset, self->elem_size);
+    atomic_store_explicit(seq, pos + self->mask + 1, memory_order_release);
+    return 1;
+}
+
+/*
+ * Returns the number of elements in the queue.
+ * The result is only a snapshot if other threads are active.
+ */
+static inline size_t mpmc_size(struct mpmc *self){
+    size_t tail = atomic_load_explicit(&self->dequeue_pos, memory_order_relaxed);
+    size_t head = atomic_load_explicit(&self->enqueue_pos, memory_order_relaxed);
+    return head > tail ? head - tail : 0;
+}
+
+/*
+ * Frees the slots of the queue.
+ */
+static inline void mpmc_free(struct mpmc *self){
+    free(self->slots);
+    self->slots = NULL;
+}
+
+#endif //MPMC_H
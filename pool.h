@@ -0,0 +1,321 @@
+/*
+   Copyright (c) 2021 Christian Döring
+   Permission is hereby granted, free of charge, to any person obtaining a copy
+   of this software and associated documentation files (the "Software"), to deal
+   in the Software without restriction, including without limitation the rights
+   to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+   copies of the Software, and to permit persons to whom the Software is
+   furnished to do so, subject to the following conditions:
+   The above copyright notice and this permission notice shall be included in all
+   copies or substantial portions of the Software.
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+   IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+   FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+   AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+   LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+   OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+   SOFTWARE.
+   */
+
+#ifndef POOL_H
+#define POOL_H
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <pthread.h>
+#include "dlist.h"
+
+/*
+ * struct pool hands out fixed size objects, e.g. structs containing a
+ * struct dlist or an MDLIST_ENTRY, from slabs of slab_objs objects.
+ *
+ * +------+-----+-----+-----+-----+
+ * | next | obj | obj | obj | ... |   slab
+ * +------+-----+-----+-----+-----+
+ *                       ^
+ *                       |
+ *                      bump
+ *
+ * New objects are carved from the current slab in address order, so nodes
+ * allocated one after another are next to each other in memory. Released
+ * objects are kept on a free list that is linked through their first bytes.
+ * Memory is only given back to the system by pool_free.
+ *
+ * The pool itself is protected by a mutex. A thread allocating and releasing
+ * many objects uses a struct pool_cache, a free list only this thread
+ * touches. It takes and returns POOL_CACHE_BATCH objects at a time, so the
+ * mutex is locked once per batch instead of once per object.
+ *
+ * Usage example:
+ *
+ *   struct conn{
+ *       struct dlist node;
+ *       int fd;
+ *   };
+ *
+ *   struct pool p;
+ *   struct pool_cache c;
+ *   struct dlist list;
+ *
+ *   pool_init(&p, struct conn, 1024);
+ *   pool_cache_init(&c, &p);
+ *   dlist_init(&list);
+ *
+ *   struct conn *conn = pool_cache_alloc(&c);
+ *   dlist_push_back(&list, &conn->node);
+ *
+ *   pool_cache_flush(&c);
+ *   pool_release_dlist_cont(&p, &list, struct conn, node);
+ *   pool_free(&p);
+ */
+struct pool_node{
+    struct pool_node *next;
+};
+
+struct pool{
+    pthread_mutex_t lock;
+    struct pool_node *free;
+    struct pool_node *slabs;
+    uint8_t *bump, *bump_end;
+    size_t obj_size, slab_objs, slab_offset;
+};
+
+/*
+ * Per thread cache of a pool. May only be used by one thread at a time.
+ */
+struct pool_cache{
+    struct pool *pool;
+    struct pool_node *free;
+    size_t count;
+};
+
+/*
+ * Number of objects a struct pool_cache takes from or returns to its pool at once.
+ */
+#ifndef POOL_CACHE_BATCH
+#define POOL_CACHE_BATCH 32
+#endif
+
+/*
+ * Initializes the pool for objects of _type.
+ *
+ * @param _self: pointer to the pool
+ * @param _type: type of the objects
+ * @param _slab_objs: number of objects per slab
+ *
+ * @return pointer to the pool (NULL if failed)
+ */
+#define pool_init(_self, _type, _slab_objs) _pool_init(_self, sizeof(_type), _Alignof(_type), _slab_objs)
+
+/*
+ * Releases all objects of a dlist of _type linked by _member.
+ * The list is empty afterwards.
+ */
+#define pool_release_dlist_cont(_self, _list_p, _type, _member) pool_release_dlist(_self, _list_p, offsetof(_type, _member))
+
+/*
+ * Releases all objects of an MDLIST linked by the ENTRY _field.
+ * The list is empty afterwards.
+ */
+#define POOL_RELEASE_MDLIST(_self, _list_p, _field){\
+    struct pool_node *_pool_head = NULL, *_pool_tail = NULL;\
+    typeof((_list_p)->_field.next) _pool_iter, _pool_next;\
+    for(_pool_iter = (_list_p)->_field.next; _pool_iter != (void *)(_list_p); _pool_iter = _pool_next){\
+        _pool_next = _pool_iter->_field.next;\
+        _pool_chain_append(&_pool_head, &_pool_tail, _pool_iter);\
+    }\
+    (_list_p)->_field.prev = (void *)(_list_p);\
+    (_list_p)->_field.next = (void *)(_list_p);\
+    _pool_release_chain(_self, _pool_head, _pool_tail);\
+}
+
+static inline struct pool *_pool_init(struct pool *self, size_t obj_size, size_t obj_align, size_t slab_objs){
+    if(obj_align < _Alignof(struct pool_node))
+        obj_align = _Alignof(struct pool_node);
+    if(obj_size < sizeof(struct pool_node))
+        obj_size = sizeof(struct pool_node);
+    self->obj_size = (obj_size + obj_align - 1) / obj_align * obj_align;
+    self->slab_offset = (sizeof(struct pool_node) + obj_align - 1) / obj_align * obj_align;
+    self->slab_objs = slab_objs > 0 ? slab_objs : 1;
+    self->free = NULL;
+    self->slabs = NULL;
+    self->bump = self->bump_end = NULL;
+    if(pthread_mutex_init(&self->lock, NULL) != 0)
+        return NULL;
+    return self;
+}
+
+/*
+ * Internal function returning an object, NULL if no slab could be allocated.
+ * The pool has to be locked.
+ */
+static inline void *_pool_alloc_locked(struct pool *self){
+    struct pool_node *obj = self->free;
+    if(obj != NULL){
+        self->free = obj->next;
+        return obj;
+    }
+    if(self->bump == self->bump_end){
+        struct pool_node *slab;
+        // malloc aligns to max_align_t, which slab_offset and obj_size are multiples of for ordinary types.
+        if((slab = (struct pool_node *)malloc(self->slab_offset + self->obj_size * self->slab_objs)) == NULL)
+            return NULL;
+        slab->next = self->slabs;
+        self->slabs = slab;
+        self->bump = (uint8_t *)slab + self->slab_offset;
+        self->bump_end = self->bump + self->obj_size * self->slab_objs;
+    }
+    obj = (struct pool_node *)self->bump;
+    self->bump += self->obj_size;
+    return obj;
+}
+
+/*
+ * Returns an uninitialized object.
+ *
+ * @return pointer to the object, NULL if failed
+ */
+static inline void *pool_alloc(struct pool *self){
+    pthread_mutex_lock(&self->lock);
+    void *obj = _pool_alloc_locked(self);
+    pthread_mutex_unlock(&self->lock);
+    return obj;
+}
+
+/*
+ * Internal function giving the chain head ... tail back to the pool.
+ */
+static inline void _pool_release_chain(struct pool *self, struct pool_node *head, struct pool_node *tail){
+    if(head == NULL)
+        return;
+    pthread_mutex_lock(&self->lock);
+    tail->next = self->free;
+    self->free = head;
+    pthread_mutex_unlock(&self->lock);
+}
+
+/*
+ * Internal function appending obj to the chain head ... tail.
+ */
+static inline void _pool_chain_append(struct pool_node **head, struct pool_node **tail, void *obj){
+    struct pool_node *node = (struct pool_node *)obj;
+    node->next = NULL;
+    if(*tail == NULL)
+        *head = node;
+    else
+        (*tail)->next = node;
+    *tail = node;
+}
+
+/*
+ * Gives obj back to the pool.
+ */
+static inline void pool_release(struct pool *self, void *obj){
+    _pool_release_chain(self, (struct pool_node *)obj, (struct pool_node *)obj);
+}
+
+/*
+ * Releases all objects of list, whose struct dlist is at offset in the objects.
+ * The objects are linked in list order, so they are handed out again in that
+ * order. The pool is locked once. The list is empty afterwards.
+ */
+static inline void pool_release_dlist(struct pool *self, struct dlist *list, size_t offset){
+    struct pool_node *head = NULL, *tail = NULL;
+    struct dlist *node, *next;
+    for(node = list->next; node != list; node = next){
+        next = node->next;
+        _pool_chain_append(&head, &tail, (uint8_t *)node - offset);
+    }
+    dlist_init(list);
+    _pool_release_chain(self, head, tail);
+}
+
+/*
+ * Frees all slabs of the pool. Every object of the pool becomes invalid.
+ */
+static inline void pool_free(struct pool *self){
+    struct pool_node *slab = self->slabs, *next;
+    for(; slab != NULL; slab = next){
+        next = slab->next;
+        free(slab);
+    }
+    self->slabs = self->free = NULL;
+    self->bump = self->bump_end = NULL;
+    pthread_mutex_destroy(&self->lock);
+}
+
+/*
+ * Initializes a cache for pool.
+ */
+static inline struct pool_cache *pool_cache_init(struct pool_cache *self, struct pool *pool){
+    self->pool = pool;
+    self->free = NULL;
+    self->count = 0;
+    return self;
+}
+
+/*
+ * Returns an uninitialized object from the cache,
+ * takes POOL_CACHE_BATCH objects from the pool if the cache is empty.
+ *
+ * @return pointer to the object, NULL if failed
+ */
+static inline void *pool_cache_alloc(struct pool_cache *self){
+    struct pool_node *obj;
+    if(self->free == NULL){
+        struct pool_node *tail = NULL;
+        pthread_mutex_lock(&self->pool->lock);
+        // Appended in order, so objects carved from a slab are handed out by ascending address.
+        while(self->count < POOL_CACHE_BATCH && (obj = (struct pool_node *)_pool_alloc_locked(self->pool)) != NULL){
+            _pool_chain_append(&self->free, &tail, obj);
+            self->count++;
+        }
+        pthread_mutex_unlock(&self->pool->lock);
+        if(self->free == NULL)
+            return NULL;
+    }
+    obj = self->free;
+    self->free = obj->next;
+    self->count--;
+    return obj;
+}
+
+/*
+ * Gives obj back to the cache,
+ * returns the POOL_CACHE_BATCH oldest objects to the pool if the cache holds twice as many.
+ * The recently released objects stay in the cache since they are likely still cache hot.
+ */
+static inline void pool_cache_release(struct pool_cache *self, void *obj){
+    struct pool_node *node = (struct pool_node *)obj;
+    node->next = self->free;
+    self->free = node;
+    if(++self->count >= 2 * POOL_CACHE_BATCH){
+        struct pool_node *last = node, *head, *tail;
+        for(size_t i = 1; i < self->count - POOL_CACHE_BATCH; i++)
+            last = last->next;
+        head = tail = last->next;
+        while(tail->next != NULL)
+            tail = tail->next;
+        last->next = NULL;
+        self->count -= POOL_CACHE_BATCH;
+        _pool_release_chain(self->pool, head, tail);
+    }
+}
+
+/*
+ * Returns all objects of the cache to the pool.
+ * Has to be called before the thread owning the cache exits.
+ */
+static inline void pool_cache_flush(struct pool_cache *self){
+    struct pool_node *tail = self->free;
+    if(tail == NULL)
+        return;
+    while(tail->next != NULL)
+        tail = tail->next;
+    _pool_release_chain(self->pool, self->free, tail);
+    self->free = NULL;
+    self->count = 0;
+}
+
+#endif //POOL_H
@@ -76,8 +76,56 @@ static inline struct slist *slist_push_front(struct slist *self, struct slist *s
 
 static inline size_t slist_length(struct slist *self){
     size_t i = 0;
-
+    slist_foreach(self, n) i++;
     return i;
 }
 
+/*
+ * slist_counted is the head of a singly linked list that keeps track of its
+ * length. The nodes are plain struct slist. Nodes of a counted list must only
+ * be added and removed through the slist_counted_* functions.
+ */
+struct slist_counted{
+    struct slist list;
+    size_t length;
+};
+
+static inline struct slist_counted *slist_counted_init(struct slist_counted *self){
+    slist_init(&self->list, NULL);
+    self->length = 0;
+    return self;
+}
+
+static inline size_t slist_counted_length(struct slist_counted *self){
+    return self->length;
+}
+
+/*
+ * Pushes src after the node dst of the list (dst may be &self->list).
+ */
+static inline struct slist *slist_counted_push_after(struct slist_counted *self, struct slist *dst, struct slist *src){
+    if(slist_push_after(dst, src) == NULL)
+        return NULL;
+    self->length++;
+    return src;
+}
+
+static inline struct slist *slist_counted_push_front(struct slist_counted *self, struct slist *src){
+    return slist_counted_push_after(self, &self->list, src);
+}
+
+/*
+ * Pops the node after src of the list (src may be &self->list).
+ */
+static inline struct slist *slist_counted_pop_after(struct slist_counted *self, struct slist *src){
+    struct slist *node;
+    if((node = slist_pop_after(src)) != NULL)
+        self->length--;
+    return node;
+}
+
+static inline struct slist *slist_counted_pop_front(struct slist_counted *self){
+    return slist_counted_pop_after(self, &self->list);
+}
+
 #endif //SLIST_H
@@ -0,0 +1,318 @@
+/*
+   Copyright (c) 2021 Christian Döring
+   Permission is hereby granted, free of charge, to any person obtaining a copy
+   of this software and associated documentation files (the "Software"), to deal
+   in the Software without restriction, including without limitation the rights
+   to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+   copies of the Software, and to permit persons to whom the Software is
+   furnished to do so, subject to the following conditions:
+   The above copyright notice and this permission notice shall be included in all
+   copies or substantial portions of the Software.
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+   IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+   FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+   AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+   LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+   OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+   SOFTWARE.
+   */
+
+#ifndef SLIST_ATOMIC_H
+#define SLIST_ATOMIC_H
+
+#include <stdint.h>
+#include <assert.h>
+#include <stdatomic.h>
+#include "slist.h"
+
+/*
+ * Lock-free containers of intrusive struct slist nodes. The next field of
+ * the nodes stays a plain pointer and is accessed with the __atomic builtins,
+ * so the same node can be moved between these and the plain slist functions.
+ * The container of a node is found with container_of as usual.
+ *
+ * struct slist_stack: Treiber stack for any number of pushing and popping
+ * threads.
+ *
+ * struct slist_mpsc: queue for any number of producers and one consumer.
+ * Pushing is wait-free (one exchange and one store).
+ *
+ * Usage example (completions of worker threads collected by an event loop):
+ *
+ *   struct completion{
+ *       struct slist node;
+ *       int result;
+ *   };
+ *
+ *   struct slist_mpsc q;
+ *   slist_mpsc_init(&q);
+ *
+ *   // any thread
+ *   slist_mpsc_push(&q, &c->node);
+ *
+ *   // event loop
+ *   struct slist *n;
+ *   while((n = slist_mpsc_pop(&q)) != NULL)
+ *       handle(container_of(n, struct completion, node));
+ */
+
+#ifndef SLIST_CACHELINE
+#define SLIST_CACHELINE 64
+#endif
+
+/*
+ * The top of the stack is a pointer and a tag that is incremented on every
+ * change, so a compare and swap fails if the top was popped and pushed
+ * again in between (ABA).
+ *
+ * If the compiler provides a 16 byte compare and swap (x86-64 with -mcx16,
+ * AArch64) pointer and tag are two full words (SLIST_STACK_DWCAS). Otherwise
+ * they are packed into one 64 bit word: with 64 bit pointers the pointer
+ * takes the lower 48 bits and the tag the upper 16. That holds every user
+ * space address on x86-64 with 4-level paging and on AArch64 without tagged
+ * pointers (TBI, MTE). Pushing a node outside of that range is caught by an
+ * assert.
+ */
+#ifndef SLIST_STACK_DWCAS
+#if defined(__SIZEOF_INT128__) && defined(__GCC_HAVE_SYNC_COMPARE_AND_SWAP_16) && UINTPTR_MAX > 0xFFFFFFFFu
+#define SLIST_STACK_DWCAS 1
+#else
+#define SLIST_STACK_DWCAS 0
+#endif
+#endif
+
+#if SLIST_STACK_DWCAS
+
+union slist_stack_top{
+    unsigned __int128 word;
+    struct{
+        struct slist *ptr;
+        uintptr_t tag;
+    };
+};
+
+struct slist_stack{
+    _Alignas(16) union slist_stack_top top;
+};
+
+static inline struct slist_stack *slist_stack_init(struct slist_stack *self){
+    self->top.ptr = NULL;
+    self->top.tag = 0;
+    return self;
+}
+
+/*
+ * Internal function reading the top. The halves are read one after the
+ * other, a torn read only makes the following compare and swap fail.
+ */
+static inline union slist_stack_top _slist_stack_load(struct slist_stack *self){
+    union slist_stack_top top;
+    top.tag = __atomic_load_n(&self->top.tag, __ATOMIC_ACQUIRE);
+    top.ptr = __atomic_load_n(&self->top.ptr, __ATOMIC_ACQUIRE);
+    return top;
+}
+
+/*
+ * Internal function replacing the top expect with node and the next tag.
+ */
+static inline int _slist_stack_cas(struct slist_stack *self, union slist_stack_top expect, struct slist *node){
+    union slist_stack_top top;
+    top.ptr = node;
+    top.tag = expect.tag + 1;
+    return __sync_bool_compare_and_swap(&self->top.word, expect.word, top.word);
+}
+
+/*
+ * Pushes node on top of the stack.
+ */
+static inline void slist_stack_push(struct slist_stack *self, struct slist *node){
+    union slist_stack_top top;
+    do{
+        top = _slist_stack_load(self);
+        __atomic_store_n(&node->next, top.ptr, __ATOMIC_RELAXED);
+    }while(!_slist_stack_cas(self, top, node));
+}
+
+/*
+ * Pops the top of the stack.
+ *
+ * The next field of the top is read before the compare and swap, while
+ * another thread may already have popped the node. Popped nodes may therefore
+ * be reused but their memory must not be unmapped as long as threads pop
+ * (e.g. nodes from a struct pool or memory that is freed at shutdown).
+ *
+ * @return the node, NULL if the stack was empty
+ */
+static inline struct slist *slist_stack_pop(struct slist_stack *self){
+    union slist_stack_top top;
+    do{
+        top = _slist_stack_load(self);
+        if(top.ptr == NULL)
+            return NULL;
+    }while(!_slist_stack_cas(self, top, __atomic_load_n(&top.ptr->next, __ATOMIC_RELAXED)));
+    return top.ptr;
+}
+
+/*
+ * Takes all nodes of the stack at once.
+ *
+ * @return the former top, the nodes are linked by next (last pushed first), NULL if empty
+ */
+static inline struct slist *slist_stack_pop_all(struct slist_stack *self){
+    union slist_stack_top top;
+    do{
+        top = _slist_stack_load(self);
+    }while(!_slist_stack_cas(self, top, NULL));
+    return top.ptr;
+}
+
+#else //SLIST_STACK_DWCAS
+
+#if UINTPTR_MAX > 0xFFFFFFFFu
+#define SLIST_TAG_SHIFT 48
+#else
+#define SLIST_TAG_SHIFT 32
+#endif
+
+#define SLIST_PTR_MASK ((UINT64_C(1) << SLIST_TAG_SHIFT) - 1)
+
+struct slist_stack{
+    _Atomic(uint64_t) top;
+};
+
+/*
+ * Internal function returning the node of a tagged top.
+ */
+static inline struct slist *_slist_tag_ptr(uint64_t top){
+    return (struct slist *)(uintptr_t)(top & SLIST_PTR_MASK);
+}
+
+/*
+ * Internal function returning node with the tag after the one of top.
+ */
+static inline uint64_t _slist_tag_next(uint64_t top, struct slist *node){
+    return (((top >> SLIST_TAG_SHIFT) + 1) << SLIST_TAG_SHIFT) | (uint64_t)(uintptr_t)node;
+}
+
+static inline struct slist_stack *slist_stack_init(struct slist_stack *self){
+    atomic_init(&self->top, 0);
+    return self;
+}
+
+/*
+ * Pushes node on top of the stack.
+ */
+static inline void slist_stack_push(struct slist_stack *self, struct slist *node){
+    assert(((uint64_t)(uintptr_t)node & ~SLIST_PTR_MASK) == 0);
+    uint64_t top = atomic_load_explicit(&self->top, memory_order_relaxed);
+    do{
+        __atomic_store_n(&node->next, _slist_tag_ptr(top), __ATOMIC_RELAXED);
+    }while(!atomic_compare_exchange_weak_explicit(&self->top, &top, _slist_tag_next(top, node),
+                memory_order_release, memory_order_relaxed));
+}
+
+/*
+ * Pops the top of the stack.
+ *
+ * The next field of the top is read before the compare and swap, while
+ * another thread may already have popped the node. Popped nodes may therefore
+ * be reused but their memory must not be unmapped as long as threads pop
+ * (e.g. nodes from a struct pool or memory that is freed at shutdown).
+ *
+ * @return the node, NULL if the stack was empty
+ */
+static inline struct slist *slist_stack_pop(struct slist_stack *self){
+    uint64_t top = atomic_load_explicit(&self->top, memory_order_acquire);
+    struct slist *node;
+    do{
+        if((node = _slist_tag_ptr(top)) == NULL)
+            return NULL;
+    }while(!atomic_compare_exchange_weak_explicit(&self->top, &top,
+                _slist_tag_next(top, __atomic_load_n(&node->next, __ATOMIC_RELAXED)),
+                memory_order_acquire, memory_order_acquire));
+    return node;
+}
+
+/*
+ * Takes all nodes of the stack at once.
+ *
+ * @return the former top, the nodes are linked by next (last pushed first), NULL if empty
+ */
+static inline struct slist *slist_stack_pop_all(struct slist_stack *self){
+    uint64_t top = atomic_load_explicit(&self->top, memory_order_relaxed);
+    while(!atomic_compare_exchange_weak_explicit(&self->top, &top, _slist_tag_next(top, NULL),
+                memory_order_acquire, memory_order_relaxed));
+    return _slist_tag_ptr(top);
+}
+
+#endif //SLIST_STACK_DWCAS
+
+/*
+ * Vyukov's intrusive MPSC queue. Producers exchange head and then link the
+ * previous head to their node. The consumer follows the next pointers from
+ * tail. The stub node keeps the queue non-empty, so neither side ever has to
+ * handle head or tail being NULL.
+ */
+struct slist_mpsc{
+    _Alignas(SLIST_CACHELINE) struct slist *head;
+    _Alignas(SLIST_CACHELINE) struct slist *tail;
+    struct slist stub;
+};
+
+static inline struct slist_mpsc *slist_mpsc_init(struct slist_mpsc *self){
+    slist_init(&self->stub, NULL);
+    self->head = &self->stub;
+    self->tail = &self->stub;
+    return self;
+}
+
+/*
+ * Pushes node to the back of the queue. May be called by any thread.
+ */
+static inline void slist_mpsc_push(struct slist_mpsc *self, struct slist *node){
+    __atomic_store_n(&node->next, NULL, __ATOMIC_RELAXED);
+    struct slist *prev = __atomic_exchange_n(&self->head, node, __ATOMIC_ACQ_REL);
+    __atomic_store_n(&prev->next, node, __ATOMIC_RELEASE);
+}
+
+/*
+ * Pops the front of the queue. May only be called by the consumer.
+ *
+ * A producer that exchanged head but did not link its node yet hides the
+ * nodes pushed after it, pop returns NULL until the link is stored.
+ *
+ * @return the node, NULL if the queue is empty (or a push is in progress)
+ */
+static inline struct slist *slist_mpsc_pop(struct slist_mpsc *self){
+    struct slist *tail = self->tail;
+    struct slist *next = __atomic_load_n(&tail->next, __ATOMIC_ACQUIRE);
+    if(tail == &self->stub){
+        if(next == NULL)
+            return NULL;
+        self->tail = next;
+        tail = next;
+        next = __atomic_load_n(&next->next, __ATOMIC_ACQUIRE);
+    }
+    if(next != NULL){
+        self->tail = next;
+        return tail;
+    }
+    if(tail != __atomic_load_n(&self->head, __ATOMIC_ACQUIRE))
+        return NULL;
+    // tail is the last node, the stub is pushed behind it so tail can be returned.
+    slist_mpsc_push(self, &self->stub);
+    if((next = __atomic_load_n(&tail->next, __ATOMIC_ACQUIRE)) != NULL){
+        self->tail = next;
+        return tail;
+    }
+    return NULL;
+}
+
+/*
+ * Returns 1 if the queue is empty. May only be called by the consumer.
+ */
+static inline int slist_mpsc_empty(struct slist_mpsc *self){
+    return self->tail == &self->stub && __atomic_load_n(&self->stub.next, __ATOMIC_ACQUIRE) == NULL;
+}
+
+#endif //SLIST_ATOMIC_H
@@ -0,0 +1,345 @@
+/*
+   Copyright (c) 2021 Christian Döring
+   Permission is hereby granted, free of charge, to any person obtaining a copy
+   of this software and associated documentation files (the "Software"), to deal
+   in the Software without restriction, including without limitation the rights
+   to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+   copies of the Software, and to permit persons to whom the Software is
+   furnished to do so, subject to the following conditions:
+   The above copyright notice and this permission notice shall be included in all
+   copies or substantial portions of the Software.
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+   IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+   FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+   AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+   LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+   OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+   SOFTWARE.
+   */
+
+#ifndef ULIST_H
+#define ULIST_H
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include "dlist.h"
+
+/*
+ * struct ulist is an unrolled list of fixed size elements. Every node of the
+ * dlist is a block holding up to block_cap elements next to each other:
+ *
+ *      +-------+---------------------+      +-------+---------------------+
+ * ---> | count | elem elem elem ---- | <--> | count | elem elem ---- ---- | <---
+ *      +-------+---------------------+      +-------+---------------------+
+ *
+ * Iterating touches one block after the other and reads the elements of a
+ * block sequentially, so there is one pointer chase per block instead of one
+ * per element.
+ *
+ * Inserting into a full block splits it in two halves, inserting at its
+ * start or end starts a new block instead. Erasing from a block that is less
+ * than half full merges it with the next block, or else with the previous
+ * one, if the elements of both fit into three quarters of a block. Elements
+ * move when blocks are split or merged, so pointers to elements are only
+ * valid until the next insert or erase.
+ *
+ * Usage example:
+ *
+ *   struct ulist l;
+ *   struct ulist_iter it;
+ *   int *i;
+ *
+ *   ulist_init(&l, int, 64);
+ *
+ *   int v = 1;
+ *   ulist_push_back(&l, &v);
+ *
+ *   ulist_foreach(&l, int, i)
+ *       printf("%i\n", *i);
+ *
+ *   for(it = ulist_begin(&l); !ulist_iter_end(&it);){
+ *       if(*(int *)ulist_iter_get(&l, &it) == 1)
+ *           ulist_erase(&l, &it);
+ *       else
+ *           ulist_iter_next(&l, &it);
+ *   }
+ *
+ *   ulist_free(&l);
+ */
+struct ulist{
+    struct dlist blocks;
+    size_t size, elem_size, block_cap;
+};
+
+struct ulist_block{
+    struct dlist node;
+    size_t count;
+    _Alignas(max_align_t) uint8_t data[];
+};
+
+/*
+ * Position of an element. block is NULL for the position past the last element.
+ */
+struct ulist_iter{
+    struct ulist_block *block;
+    size_t index;
+};
+
+/*
+ * Initializes the list for elements of _type.
+ *
+ * @param _self: pointer to the list
+ * @param _type: type of the elements
+ * @param _block_cap: number of elements per block
+ *
+ * @return pointer to the list
+ */
+#define ulist_init(_self, _type, _block_cap) _ulist_init(_self, sizeof(_type), _block_cap)
+
+/*
+ * Iterates over the elements of the list block by block. A break in the body
+ * leaves the inner loop over the block early, which the outer loop detects
+ * and stops as well.
+ *
+ * @param _self: pointer to the list
+ * @param _type: type of the elements
+ * @param _elem_p: name of the element pointer (_type *)
+ */
+#define ulist_foreach(_self, _type, _elem_p)\
+    for(struct ulist_block *_ulist_b = _ulist_block(_self, (_self)->blocks.next);\
+        _ulist_b != NULL;\
+        _ulist_b = (_elem_p) == (_type *)_ulist_b->data + _ulist_b->count ? _ulist_block(_self, _ulist_b->node.next) : NULL)\
+        for((_elem_p) = (_type *)_ulist_b->data; (_elem_p) != (_type *)_ulist_b->data + _ulist_b->count; (_elem_p)++)
+
+static inline struct ulist *_ulist_init(struct ulist *self, size_t elem_size, size_t block_cap){
+    dlist_init(&self->blocks);
+    self->size = 0;
+    self->elem_size = elem_size;
+    self->block_cap = block_cap > 0 ? block_cap : 1;
+    return self;
+}
+
+/*
+ * Returns the number of elements in the list.
+ */
+static inline size_t ulist_size(struct ulist *self){
+    return self->size;
+}
+
+/*
+ * Internal function returning the block of node, NULL if node is the head.
+ */
+static inline struct ulist_block *_ulist_block(struct ulist *self, struct dlist *node){
+    return node == &self->blocks ? NULL : container_of(node, struct ulist_block, node);
+}
+
+/*
+ * Internal function returning the element at index of block.
+ */
+static inline uint8_t *_ulist_elem(struct ulist *self, struct ulist_block *block, size_t index){
+    return block->data + index * self->elem_size;
+}
+
+/*
+ * Internal function allocating an empty block and linking it after node.
+ */
+static inline struct ulist_block *_ulist_block_alloc(struct ulist *self, struct dlist *node){
+    struct ulist_block *block;
+    if((block = (struct ulist_block *)malloc(sizeof(struct ulist_block) + self->block_cap * self->elem_size)) == NULL)
+        return NULL;
+    block->count = 0;
+    dlist_push_after(node, &block->node);
+    return block;
+}
+
+/*
+ * Returns the position of the first element.
+ */
+static inline struct ulist_iter ulist_begin(struct ulist *self){
+    struct ulist_iter iter = {_ulist_block(self, self->blocks.next), 0};
+    return iter;
+}
+
+/*
+ * Returns the position past the last element.
+ */
+static inline struct ulist_iter ulist_end(struct ulist *self){
+    (void)self;
+    struct ulist_iter iter = {NULL, 0};
+    return iter;
+}
+
+/*
+ * Returns the position of the element at index, walks the list block by block.
+ */
+static inline struct ulist_iter ulist_iter_at(struct ulist *self, size_t index){
+    struct ulist_iter iter = ulist_begin(self);
+    while(iter.block != NULL && index >= iter.block->count){
+        index -= iter.block->count;
+        iter.block = _ulist_block(self, iter.block->node.next);
+    }
+    iter.index = iter.block != NULL ? index : 0;
+    return iter;
+}
+
+/*
+ * Returns 1 if iter is past the last element.
+ */
+static inline int ulist_iter_end(const struct ulist_iter *iter){
+    return iter->block == NULL;
+}
+
+/*
+ * Returns a pointer to the element at iter.
+ */
+static inline void *ulist_iter_get(struct ulist *self, const struct ulist_iter *iter){
+    return _ulist_elem(self, iter->block, iter->index);
+}
+
+/*
+ * Advances iter to the next element.
+ */
+static inline void ulist_iter_next(struct ulist *self, struct ulist_iter *iter){
+    if(++iter->index >= iter->block->count){
+        iter->block = _ulist_block(self, iter->block->node.next);
+        iter->index = 0;
+    }
+}
+
+/*
+ * Inserts a copy of elem before the element at iter.
+ * iter points to the inserted element afterwards.
+ *
+ * @return int: 1 if succes, 0 if failed
+ */
+static inline int ulist_insert(struct ulist *self, struct ulist_iter *iter, const void *elem){
+    struct ulist_block *block = iter->block, *new_block;
+    size_t index = iter->index;
+    if(block == NULL){
+        block = _ulist_block(self, self->blocks.prev);
+        index = block != NULL ? block->count : 0;
+    }
+
+    if(block == NULL){
+        if((block = _ulist_block_alloc(self, &self->blocks)) == NULL)
+            return 0;
+    }
+    else if(block->count == self->block_cap){
+        // Inserting at the start or end of a full block starts a new block, so
+        // pushing to the front or back fills blocks completely.
+        if(index == 0 || index == block->count){
+            if((new_block = _ulist_block_alloc(self, index == 0 ? block->node.prev : &block->node)) == NULL)
+                return 0;
+            block = new_block;
+            index = 0;
+        }
+        else{
+            size_t half = block->count / 2;
+            if((new_block = _ulist_block_alloc(self, &block->node)) == NULL)
+                return 0;
+            memcpy(new_block->data, _ulist_elem(self, block, half), (block->count - half) * self->elem_size);
+            new_block->count = block->count - half;
+            block->count = half;
+            if(index > half){
+                block = new_block;
+                index -= half;
+            }
+        }
+    }
+
+    memmove(_ulist_elem(self, block, index + 1), _ulist_elem(self, block, index), (block->count - index) * self->elem_size);
+    memcpy(_ulist_elem(self, block, index), elem, self->elem_size);
+    block->count++;
+    self->size++;
+    iter->block = block;
+    iter->index = index;
+    return 1;
+}
+
+/*
+ * Erases the element at iter.
+ * iter points to the element after the erased one afterwards.
+ */
+static inline void ulist_erase(struct ulist *self, struct ulist_iter *iter){
+    struct ulist_block *block = iter->block, *next, *prev;
+    size_t index = iter->index;
+
+    memmove(_ulist_elem(self, block, index), _ulist_elem(self, block, index + 1), (block->count - index - 1) * self->elem_size);
+    block->count--;
+    self->size--;
+    next = _ulist_block(self, block->node.next);
+
+    if(block->count == 0){
+        dlist_pop(&block->node);
+        free(block);
+        iter->block = next;
+        iter->index = 0;
+        return;
+    }
+    if(block->count < self->block_cap / 2){
+        size_t limit = self->block_cap - self->block_cap / 4;
+        prev = _ulist_block(self, block->node.prev);
+        if(next != NULL && block->count + next->count <= limit){
+            memcpy(_ulist_elem(self, block, block->count), next->data, next->count * self->elem_size);
+            block->count += next->count;
+            dlist_pop(&next->node);
+            free(next);
+            next = _ulist_block(self, block->node.next);
+        }
+        else if(prev != NULL && prev->count + block->count <= limit){
+            // The last block or one before a full block is merged into its
+            // predecessor, so it does not stay almost empty.
+            memcpy(_ulist_elem(self, prev, prev->count), block->data, block->count * self->elem_size);
+            index += prev->count;
+            prev->count += block->count;
+            dlist_pop(&block->node);
+            free(block);
+            block = prev;
+        }
+    }
+    if(index == block->count){
+        iter->block = next;
+        iter->index = 0;
+    }
+    else{
+        iter->block = block;
+        iter->index = index;
+    }
+}
+
+/*
+ * Appends a copy of elem to the list.
+ *
+ * @return int: 1 if succes, 0 if failed
+ */
+static inline int ulist_push_back(struct ulist *self, const void *elem){
+    struct ulist_iter iter = ulist_end(self);
+    return ulist_insert(self, &iter, elem);
+}
+
+/*
+ * Prepends a copy of elem to the list.
+ *
+ * @return int: 1 if succes, 0 if failed
+ */
+static inline int ulist_push_front(struct ulist *self, const void *elem){
+    struct ulist_iter iter = ulist_begin(self);
+    return ulist_insert(self, &iter, elem);
+}
+
+/*
+ * Frees all blocks of the list.
+ */
+static inline void ulist_free(struct ulist *self){
+    struct dlist *node = self->blocks.next, *next;
+    for(; node != &self->blocks; node = next){
+        next = node->next;
+        free(container_of(node, struct ulist_block, node));
+    }
+    dlist_init(&self->blocks);
+    self->size = 0;
+}
+
+#endif //ULIST_H